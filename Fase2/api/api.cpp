@@ -7,6 +7,21 @@
 #include <security/pam_appl.h>
 #include <security/pam_misc.h>
 #include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <future>
+#include <charconv>
+#include <cstdio>
+#include <atomic>
+#include <array>
+#include <vector>
+#include <chrono>
+#include <ctime>
+#include <algorithm>
+#include <set>
+#include <fcntl.h>
 // Definición dde codigos de las syscalls
 #define SYS_KERNEL_LOGS 549
 #define SYS_UPTIME_S 550
@@ -14,6 +29,796 @@
 #define SYS_RAM_USAGE 552
 #define SYS_MY_ENCRYPT 553
 #define SYS_MY_DECRYPT 554
+#define SYS_MY_DECRYPT_RANGE 555
+#define SYS_MY_CRYPT_BUFFER 556
+#define SYS_CRYPT_JOB_CTL 557
+#define SYS_TOP_TASKS 558
+#define SYS_STATS_PRESSURE_OPEN 559
+#define SYS_CGROUP_USAGE 560
+
+// Modos de cifrado de my_encrypt/my_decrypt (kernel/syscall_crypt.h)
+#define CRYPT_MODE_XOR 0
+#define CRYPT_MODE_CHACHA20 1
+// Banderas que se suman al modo: I/O directo, sin pasar por el page cache
+#define CRYPT_FLAG_DIRECT 0x100
+#define CRYPT_FLAG_DIRECT_INPUT 0x200
+#define CRYPT_FLAG_LZ4 0x400 // Comprimir antes de cifrar; hay que pedirlo también al descifrar
+#define CRYPT_FLAG_VERIFY 0x800 // my_decrypt: comparar contra el checksum que se le pasa
+
+// Bytes extra que agrega la cabecera de ChaCha20 (struct crypt_file_header)
+#define CRYPT_HEADER_SIZE 32
+
+// Argumentos de my_crypt_buffer (mismo layout que struct crypt_buffer_args del kernel)
+struct crypt_buffer_args {
+    uint64_t input;
+    uint64_t input_length;
+    uint64_t output;
+    uint64_t output_length;
+    uint64_t key;
+    uint64_t key_length;
+    int32_t thread_count;
+    int32_t mode;
+    uint32_t flags;
+    uint32_t reserved;
+};
+#define CRYPT_BUFFER_DECRYPT 0x1
+
+// crypt_job_ctl (kernel/syscall_crypt.h)
+#define CRYPT_JOB_QUERY 0
+#define CRYPT_JOB_CANCEL 1
+struct crypt_job_status {
+    uint64_t bytes_total;
+    uint64_t bytes_done;
+    uint32_t phase;
+    uint32_t cancelled;
+};
+static const char* crypt_job_phases[] = { "reading", "processing", "writing" };
+
+// Nombre del modo -> CRYPT_MODE_*; -1 si no es un modo conocido
+static int crypt_mode_from_name(const std::string& mode) {
+    if (mode == "xor") return CRYPT_MODE_XOR;
+    if (mode == "chacha20") return CRYPT_MODE_CHACHA20;
+    return -1;
+}
+
+// Traduce el campo opcional "mode" del JSON
+static int parse_crypt_mode(const crow::json::rvalue& body) {
+    if (!body.has("mode")) return CRYPT_MODE_XOR;
+    return crypt_mode_from_name(body["mode"].s());
+}
+
+// Campos opcionales "direct" / "direct_input" -> CRYPT_FLAG_* (para trabajos grandes
+// que no deben desalojar el page cache de otros servicios) y "compress" (LZ4)
+static int parse_crypt_flags(const crow::json::rvalue& body) {
+    int flags = 0;
+    if (body.has("direct") && body["direct"].b()) flags |= CRYPT_FLAG_DIRECT;
+    if (body.has("direct_input") && body["direct_input"].b()) flags |= CRYPT_FLAG_DIRECT_INPUT;
+    if (body.has("compress") && body["compress"].b()) flags |= CRYPT_FLAG_LZ4;
+    return flags;
+}
+
+// Checksum CRC32C de my_encrypt/my_decrypt <-> texto hexadecimal del JSON
+static std::string checksum_to_hex(uint32_t checksum) {
+    char hex[9];
+    snprintf(hex, sizeof(hex), "%08x", checksum);
+    return hex;
+}
+
+static bool checksum_from_hex(const std::string& hex, uint32_t* checksum) {
+    if (hex.empty() || hex.size() > 8) return false;
+    char* end = nullptr;
+    unsigned long value = strtoul(hex.c_str(), &end, 16);
+    if (*end != '\0') return false;
+    *checksum = (uint32_t)value;
+    return true;
+}
+
+// /encrypt/inline y /decrypt/inline: el cuerpo de la petición es el dato, la clave va
+// en el header X-Key y los hilos/modo en la query (?threads=4&mode=chacha20).
+static crow::response crypt_inline(const crow::request& req, bool decrypt) {
+    const std::string& key = req.get_header_value("X-Key");
+    if (key.empty() || req.body.empty()) {
+        return crow::response(400, "Falta el cuerpo o el header X-Key");
+    }
+    const char* threads_param = req.url_params.get("threads");
+    const char* mode_param = req.url_params.get("mode");
+    int threads = threads_param ? atoi(threads_param) : 0; // 0 = el kernel elige
+    int mode = mode_param ? crypt_mode_from_name(mode_param) : CRYPT_MODE_XOR;
+    if (threads < 0 || mode < 0) {
+        return crow::response(400, "Parametros threads/mode invalidos");
+    }
+
+    // Al cifrar con ChaCha20 la salida lleva la cabecera con el nonce
+    size_t header = (mode == CRYPT_MODE_CHACHA20) ? CRYPT_HEADER_SIZE : 0;
+    std::string output(decrypt ? req.body.size() : req.body.size() + header, '\0');
+
+    crypt_buffer_args args{};
+    args.input = (uint64_t)(uintptr_t)req.body.data();
+    args.input_length = req.body.size();
+    args.output = (uint64_t)(uintptr_t)&output[0];
+    args.output_length = output.size();
+    args.key = (uint64_t)(uintptr_t)key.data();
+    args.key_length = key.size();
+    args.thread_count = threads;
+    args.mode = mode;
+    args.flags = decrypt ? CRYPT_BUFFER_DECRYPT : 0;
+
+    long result = syscall(SYS_MY_CRYPT_BUFFER, &args, sizeof(args));
+    if (result < 0) {
+        return crow::response(500, "Ocurrió un error en el kernel (Error: " + std::to_string(-errno) + ")");
+    }
+    output.resize(result);
+
+    crow::response res(200, output);
+    res.set_header("Content-Type", "application/octet-stream");
+    return res;
+}
+
+// --- Trabajos asíncronos de /encrypt y /decrypt ---
+// Con "async": true la syscall corre en un hilo aparte y la respuesta trae un job_id:
+// el TID de ese hilo, que es como el kernel identifica el trabajo en crypt_job_ctl.
+// Un resultado que nadie pide en JOB_RESULT_TTL se descarta (si no, cada trabajo
+// async sin consultar quedaría en el mapa mientras viva el proceso).
+#define JOB_RESULT_TTL std::chrono::minutes(10)
+struct CryptJob {
+    bool done = false;
+    long result = 0; // Resultado de la syscall (-errno si falló)
+    bool has_checksum = false;
+    uint32_t checksum = 0; // CRC32C del archivo cifrado entero, si se pidió
+    std::chrono::steady_clock::time_point finished; // Cuándo terminó (si done)
+};
+static std::mutex jobs_mutex;
+static std::map<pid_t, std::shared_ptr<CryptJob>> jobs;
+
+// Borra los trabajos terminados hace más de JOB_RESULT_TTL. Con jobs_mutex tomado.
+static void prune_jobs() {
+    auto now = std::chrono::steady_clock::now();
+    for (auto it = jobs.begin(); it != jobs.end();) {
+        if (it->second->done && now - it->second->finished > JOB_RESULT_TTL) it = jobs.erase(it);
+        else ++it;
+    }
+}
+
+// 'want_checksum' pide el CRC32C al kernel; con CRYPT_FLAG_VERIFY en 'mode', 'checksum' es el esperado.
+static pid_t start_crypt_job(long sysno, const std::string& input, const std::string& output,
+                             const std::string& key, int threads, int mode,
+                             bool want_checksum, uint32_t checksum) {
+    std::promise<pid_t> started;
+    std::future<pid_t> job_id = started.get_future();
+
+    std::thread([=, started = std::move(started)]() mutable {
+        pid_t tid = syscall(SYS_gettid);
+        auto job = std::make_shared<CryptJob>();
+        {
+            std::lock_guard<std::mutex> lock(jobs_mutex);
+            prune_jobs();
+            jobs[tid] = job; // Un TID reutilizado reemplaza al trabajo viejo
+        }
+        started.set_value(tid);
+
+        uint32_t crc = checksum;
+        long result = syscall(sysno, input.c_str(), output.c_str(), key.c_str(), threads, mode,
+                              want_checksum ? &crc : nullptr);
+        if (result < 0) result = -errno;
+
+        std::lock_guard<std::mutex> lock(jobs_mutex);
+        job->result = result;
+        job->has_checksum = want_checksum && result >= 0;
+        job->checksum = crc;
+        job->finished = std::chrono::steady_clock::now();
+        job->done = true;
+    }).detach();
+
+    return job_id.get();
+}
+
+// --- Respuestas JSON de esquema fijo (/stats, /uptime, /logs) ---
+// Estos endpoints se consultan todo el tiempo (el dashboard los refresca cada pocos
+// segundos). En vez de armar un crow::json::wvalue (un nodo en el heap por clave) y
+// después serializarlo, la respuesta se escribe directo en un buffer por hilo con las
+// claves ya formateadas. Armar el JSON no reserva memoria; lo que queda es lo que
+// reserva crow::response en json_response: el cuerpo std::string y el header
+// Content-Type (set_header). bench_alloc.cpp lo mide.
+class JsonWriter {
+public:
+    JsonWriter(char* buffer, size_t capacity) : buffer_(buffer), capacity_(capacity) {}
+
+    // Fragmento fijo ya formateado, ej. "{\"uptime_seconds\":"
+    template <size_t N>
+    JsonWriter& raw(const char (&fragment)[N]) { return append(fragment, N - 1); }
+
+    JsonWriter& number(long long value) {
+        if (overflow_) return *this;
+        auto result = std::to_chars(buffer_ + length_, buffer_ + capacity_, value);
+        if (result.ec != std::errc()) overflow_ = true;
+        else length_ = result.ptr - buffer_;
+        return *this;
+    }
+
+    // Porcentajes: siempre con dos decimales
+    JsonWriter& fixed2(double value) {
+        if (overflow_) return *this;
+        int written = snprintf(buffer_ + length_, capacity_ - length_, "%.2f", value);
+        if (written < 0 || (size_t)written >= capacity_ - length_) overflow_ = true;
+        else length_ += written;
+        return *this;
+    }
+
+    // Cadena entre comillas, escapando lo que JSON no acepta tal cual
+    JsonWriter& string(const char* data, size_t size) {
+        static const char hex[] = "0123456789abcdef";
+        append("\"", 1);
+        for (size_t i = 0; i < size && !overflow_; i++) {
+            unsigned char c = data[i];
+            switch (c) {
+                case '"':  append("\\\"", 2); break;
+                case '\\': append("\\\\", 2); break;
+                case '\n': append("\\n", 2); break;
+                case '\t': append("\\t", 2); break;
+                case '\r': append("\\r", 2); break;
+                default:
+                    if (c < 0x20) {
+                        char escaped[6] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xf] };
+                        append(escaped, sizeof(escaped));
+                    } else {
+                        append(&data[i], 1);
+                    }
+            }
+        }
+        return append("\"", 1);
+    }
+
+    // Texto que se sabe que no necesita escape (ej. nombres de una tabla fija)
+    JsonWriter& raw_dynamic(const char* text) { return append(text, strlen(text)); }
+
+    bool ok() const { return !overflow_; }
+    const char* data() const { return buffer_; }
+    size_t size() const { return length_; }
+
+private:
+    JsonWriter& append(const char* data, size_t size) {
+        if (overflow_ || size > capacity_ - length_) {
+            overflow_ = true;
+            return *this;
+        }
+        memcpy(buffer_ + length_, data, size);
+        length_ += size;
+        return *this;
+    }
+
+    char* buffer_;
+    size_t capacity_;
+    size_t length_ = 0;
+    bool overflow_ = false;
+};
+
+// Alcanza para /logs aunque cada byte del log se escape como \u00XX, y en formato
+// "records" para las claves de cada registro (el más chico ocupa 24 bytes en el buffer)
+#define LOG_BUFFER_SIZE (4 * 1024)
+#define JSON_BUFFER_SIZE (LOG_BUFFER_SIZE * 12)
+static thread_local char json_buffer[JSON_BUFFER_SIZE];
+alignas(8) static thread_local char logs_buffer[LOG_BUFFER_SIZE + 1];
+
+// kernel_logs (kernel/syscall_logs.c)
+#define KERNEL_LOGS_TEXT 0
+#define KERNEL_LOGS_RECORDS 1
+struct kernel_log_record {
+    uint64_t seq;
+    uint64_t ts_nsec;
+    uint8_t level;
+    uint8_t facility;
+    uint16_t text_len;
+    uint32_t text_offset; // Desde el inicio del buffer
+};
+static const char* log_level_names[] = { "emerg", "alert", "crit", "err", "warning", "notice", "info", "debug" };
+
+static crow::response json_response(const JsonWriter& json) {
+    if (!json.ok()) {
+        return crow::response(500, "Respuesta demasiado grande");
+    }
+    crow::response res(200, std::string(json.data(), json.size()));
+    res.set_header("Content-Type", "application/json");
+    return res;
+}
+
+// --- Historial de /stats ---
+// Un hilo toma una muestra de CPU/RAM por segundo y la guarda en tres anillos de
+// tamaño fijo: cada segundo (última hora), cada minuto (último día) y cada hora
+// (últimos 30 días), estos dos con mínimo/máximo/promedio del período. /stats/history
+// lee de ahí sin llamar a las syscalls, y la memoria usada no crece con el tiempo.
+struct StatsSample {
+    int64_t t = 0;                 // Inicio del período (epoch, segundos)
+    int32_t cpu_min = 0, cpu_max = 0, cpu_avg = 0; // Mismo formato que /stats (1500 = 15.00%)
+    int32_t ram_min = 0, ram_max = 0, ram_avg = 0;
+};
+
+// Anillo con un solo escritor (el hilo muestreador) y lectores sin lock. Cada casillero
+// lleva un contador de secuencia (seqlock): impar mientras se escribe, y el lector
+// descarta la copia si lo vio impar o si cambió mientras copiaba.
+template <size_t N>
+class StatsRing {
+public:
+    static constexpr size_t capacity = N;
+
+    void push(const StatsSample& sample) {
+        uint64_t n = count_.load(std::memory_order_relaxed);
+        Slot& slot = slots_[n % N];
+        uint32_t seq = slot.seq.load(std::memory_order_relaxed);
+        slot.seq.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.index.store(n, std::memory_order_relaxed);
+        slot.t.store(sample.t, std::memory_order_relaxed);
+        slot.values[0].store(sample.cpu_min, std::memory_order_relaxed);
+        slot.values[1].store(sample.cpu_max, std::memory_order_relaxed);
+        slot.values[2].store(sample.cpu_avg, std::memory_order_relaxed);
+        slot.values[3].store(sample.ram_min, std::memory_order_relaxed);
+        slot.values[4].store(sample.ram_max, std::memory_order_relaxed);
+        slot.values[5].store(sample.ram_avg, std::memory_order_relaxed);
+        slot.seq.store(seq + 2, std::memory_order_release);
+        count_.store(n + 1, std::memory_order_release);
+    }
+
+    // Agrega a 'out' las muestras con t >= since, de la más vieja a la más nueva
+    void read(int64_t since, std::vector<StatsSample>& out) const {
+        uint64_t n = count_.load(std::memory_order_acquire);
+        StatsSample sample;
+        for (uint64_t i = n > N ? n - N : 0; i < n; i++) {
+            if (read_slot(i, sample) && sample.t >= since) out.push_back(sample);
+        }
+    }
+
+private:
+    struct Slot {
+        std::atomic<uint32_t> seq{0};
+        std::atomic<uint64_t> index{0}; // Número de muestra guardada (para detectar que la pisaron)
+        std::atomic<int64_t> t{0};
+        std::array<std::atomic<int32_t>, 6> values{};
+    };
+
+    // false si el escritor ya reemplazó la muestra 'i' por una más nueva
+    bool read_slot(uint64_t i, StatsSample& sample) const {
+        const Slot& slot = slots_[i % N];
+        for (;;) {
+            uint32_t seq = slot.seq.load(std::memory_order_acquire);
+            if (seq & 1) continue; // El escritor está en medio de este casillero
+            uint64_t index = slot.index.load(std::memory_order_relaxed);
+            sample.t = slot.t.load(std::memory_order_relaxed);
+            sample.cpu_min = slot.values[0].load(std::memory_order_relaxed);
+            sample.cpu_max = slot.values[1].load(std::memory_order_relaxed);
+            sample.cpu_avg = slot.values[2].load(std::memory_order_relaxed);
+            sample.ram_min = slot.values[3].load(std::memory_order_relaxed);
+            sample.ram_max = slot.values[4].load(std::memory_order_relaxed);
+            sample.ram_avg = slot.values[5].load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.seq.load(std::memory_order_relaxed) == seq) return index == i;
+        }
+    }
+
+    std::array<Slot, N> slots_;
+    std::atomic<uint64_t> count_{0}; // Muestras escritas desde que arrancó
+};
+
+static StatsRing<3600> stats_history_1s; // 1 hora
+static StatsRing<1440> stats_history_1m; // 1 día
+static StatsRing<720> stats_history_1h;  // 30 días
+
+// Junta las muestras de un período (minuto u hora) en una sola. Solo la usa el muestreador.
+struct StatsRollup {
+    int64_t period;
+    int64_t bucket = -1;
+    StatsSample total;
+    int64_t cpu_sum = 0, ram_sum = 0, count = 0;
+
+    explicit StatsRollup(int64_t period) : period(period) {}
+
+    template <size_t N>
+    void add(const StatsSample& sample, StatsRing<N>& ring) {
+        int64_t b = sample.t / period;
+        if (b != bucket && count > 0) {
+            total.cpu_avg = (int32_t)(cpu_sum / count);
+            total.ram_avg = (int32_t)(ram_sum / count);
+            ring.push(total);
+            count = 0;
+        }
+        if (count == 0) {
+            bucket = b;
+            total = sample;
+            total.t = b * period;
+            cpu_sum = ram_sum = 0;
+        }
+        total.cpu_min = std::min(total.cpu_min, sample.cpu_min);
+        total.cpu_max = std::max(total.cpu_max, sample.cpu_max);
+        total.ram_min = std::min(total.ram_min, sample.ram_min);
+        total.ram_max = std::max(total.ram_max, sample.ram_max);
+        cpu_sum += sample.cpu_avg;
+        ram_sum += sample.ram_avg;
+        count++;
+    }
+};
+
+static void stats_sampler() {
+    StatsRollup minute(60), hour(3600);
+    auto next = std::chrono::steady_clock::now();
+    for (;;) {
+        next += std::chrono::seconds(1);
+        int cpu_usage = 0, ram_usage = 0;
+        if (syscall(SYS_CPU_USAGE, &cpu_usage) == 0 && syscall(SYS_RAM_USAGE, &ram_usage) == 0) {
+            StatsSample sample;
+            sample.t = time(nullptr);
+            sample.cpu_min = sample.cpu_max = sample.cpu_avg = cpu_usage;
+            sample.ram_min = sample.ram_max = sample.ram_avg = ram_usage;
+            stats_history_1s.push(sample);
+            minute.add(sample, stats_history_1m);
+            hour.add(sample, stats_history_1h);
+        }
+        std::this_thread::sleep_until(next);
+    }
+}
+
+// /stats/history?range=<segundos>&step=<segundos>
+// 'step' elige el anillo (1 s, 1 min o 1 h) y si es mayor que su resolución se agrupan
+// las muestras de a 'step' segundos. Sin 'step' se usa la resolución más fina que cubre 'range'.
+static crow::response stats_history(const crow::request& req) {
+    const char* range_param = req.url_params.get("range");
+    const char* step_param = req.url_params.get("step");
+    long range = range_param ? atol(range_param) : 3600;
+    if (range <= 0) {
+        return crow::response(400, "Parametro range invalido");
+    }
+    long step = step_param ? atol(step_param)
+              : range <= (long)stats_history_1s.capacity ? 1
+              : range <= (long)stats_history_1m.capacity * 60 ? 60 : 3600;
+    if (step <= 0) {
+        return crow::response(400, "Parametro step invalido");
+    }
+
+    std::vector<StatsSample> samples;
+    int64_t since = time(nullptr) - range;
+    if (step >= 3600) stats_history_1h.read(since, samples);
+    else if (step >= 60) stats_history_1m.read(since, samples);
+    else stats_history_1s.read(since, samples);
+
+    // Reducir a un punto por cada 'step' segundos
+    std::vector<StatsSample> points;
+    int64_t cpu_sum = 0, ram_sum = 0, count = 0;
+    for (const StatsSample& sample : samples) {
+        int64_t t = sample.t - sample.t % step;
+        if (points.empty() || points.back().t != t) {
+            if (count) {
+                points.back().cpu_avg = (int32_t)(cpu_sum / count);
+                points.back().ram_avg = (int32_t)(ram_sum / count);
+            }
+            points.push_back(sample);
+            points.back().t = t;
+            cpu_sum = ram_sum = count = 0;
+        }
+        StatsSample& point = points.back();
+        point.cpu_min = std::min(point.cpu_min, sample.cpu_min);
+        point.cpu_max = std::max(point.cpu_max, sample.cpu_max);
+        point.ram_min = std::min(point.ram_min, sample.ram_min);
+        point.ram_max = std::max(point.ram_max, sample.ram_max);
+        cpu_sum += sample.cpu_avg;
+        ram_sum += sample.ram_avg;
+        count++;
+    }
+    if (count) {
+        points.back().cpu_avg = (int32_t)(cpu_sum / count);
+        points.back().ram_avg = (int32_t)(ram_sum / count);
+    }
+
+    // Los valores van en porcentaje, como cpu_usage_percentage / ram_usage_percentage de /stats
+    std::string body(128 + points.size() * 192, '\0');
+    JsonWriter json(&body[0], body.size());
+    json.raw("{\"range\":").number(range).raw(",\"step\":").number(step).raw(",\"points\":[");
+    for (size_t i = 0; i < points.size(); i++) {
+        const StatsSample& point = points[i];
+        if (i) json.raw(",");
+        json.raw("{\"t\":").number(point.t)
+            .raw(",\"cpu\":{\"min\":").fixed2(point.cpu_min / 100.0)
+            .raw(",\"max\":").fixed2(point.cpu_max / 100.0)
+            .raw(",\"avg\":").fixed2(point.cpu_avg / 100.0)
+            .raw("},\"ram\":{\"min\":").fixed2(point.ram_min / 100.0)
+            .raw(",\"max\":").fixed2(point.ram_max / 100.0)
+            .raw(",\"avg\":").fixed2(point.ram_avg / 100.0)
+            .raw("}}");
+    }
+    json.raw("]}");
+    if (!json.ok()) {
+        return crow::response(500, "Respuesta demasiado grande");
+    }
+    body.resize(json.size());
+    crow::response res(200, std::move(body));
+    res.set_header("Content-Type", "application/json");
+    return res;
+}
+
+// --- /stats/top ---
+// Un proceso de top_tasks (mismo layout que struct top_task en kernel/syscall_top_tasks.c)
+struct top_task {
+    int32_t pid;
+    uint32_t cpu_x100;   // % de una CPU x100 en el intervalo
+    uint64_t cpu_ns;
+    uint64_t rss_bytes;
+    char comm[16];
+};
+#define TOP_TASKS_MAX 64
+
+static void write_top_tasks(JsonWriter& json, const top_task* tasks, long count) {
+    for (long i = 0; i < count; i++) {
+        if (i) json.raw(",");
+        json.raw("{\"pid\":").number(tasks[i].pid)
+            .raw(",\"comm\":").string(tasks[i].comm, strnlen(tasks[i].comm, sizeof(tasks[i].comm)))
+            .raw(",\"cpu_percentage\":").fixed2(tasks[i].cpu_x100 / 100.0)
+            .raw(",\"cpu_ns\":").number((long long)tasks[i].cpu_ns)
+            .raw(",\"rss_bytes\":").number((long long)tasks[i].rss_bytes)
+            .raw("}");
+    }
+}
+
+// /stats/top?n=10: quién está usando la CPU y la memoria, en una sola syscall
+static crow::response stats_top(const crow::request& req) {
+    const char* n_param = req.url_params.get("n");
+    int n = n_param ? atoi(n_param) : 10;
+    if (n <= 0 || n > TOP_TASKS_MAX) {
+        return crow::response(400, "Parametro n invalido (1 a 64)");
+    }
+
+    top_task by_cpu[TOP_TASKS_MAX], by_rss[TOP_TASKS_MAX];
+    uint64_t interval_ns = 0;
+    long count = syscall(SYS_TOP_TASKS, by_cpu, by_rss, (unsigned int)n, &interval_ns);
+    if (count < 0) {
+        return crow::response(500, "Ocurrió un error en el kernel (Error: " + std::to_string(-errno) + ")");
+    }
+
+    JsonWriter json(json_buffer, sizeof(json_buffer));
+    json.raw("{\"interval_ns\":").number((long long)interval_ns).raw(",\"by_cpu\":[");
+    write_top_tasks(json, by_cpu, count);
+    json.raw("],\"by_rss\":[");
+    write_top_tasks(json, by_rss, count);
+    json.raw("]}");
+    return json_response(json);
+}
+
+// --- /stats?cgroup= ---
+// Un cgroup de cgroup_usage (mismo layout que en kernel/syscall_cgroup_usage.c)
+struct cgroup_usage {
+    int32_t fd;          // -1: se usa path
+    int32_t error;
+    uint64_t path;       // const char*
+    uint64_t cpu_ns;
+    uint64_t interval_ns;
+    uint64_t mem_bytes;
+    uint64_t mem_limit_bytes;
+    uint32_t cpu_x100;   // Mismo formato que cpu_usage (1500 = 15.00%)
+    uint32_t mem_x100;
+    uint64_t reserved;
+};
+#define CGROUP_USAGE_MAX 32
+
+// ?cgroup=/system.slice,/user.slice: rutas dentro de la jerarquía v2 separadas por coma
+static bool split_cgroup_paths(const char* list, std::vector<std::string>& paths) {
+    std::string current;
+    for (const char* c = list; ; c++) {
+        if (*c == ',' || *c == '\0') {
+            if (current.empty()) return false;
+            paths.push_back(current);
+            current.clear();
+            if (*c == '\0') break;
+        } else {
+            current += *c;
+        }
+    }
+    return paths.size() <= CGROUP_USAGE_MAX;
+}
+
+// Todos los cgroups en una sola syscall (y a lo sumo una espera de 100ms en el kernel)
+static long read_cgroup_usage(const std::vector<std::string>& paths, cgroup_usage* usage) {
+    for (size_t i = 0; i < paths.size(); i++) {
+        usage[i] = cgroup_usage{};
+        usage[i].fd = -1;
+        usage[i].path = (uint64_t)(uintptr_t)paths[i].c_str();
+    }
+    return syscall(SYS_CGROUP_USAGE, usage, (unsigned int)paths.size());
+}
+
+static void write_cgroup_usage(JsonWriter& json, const std::vector<std::string>& paths,
+                               const cgroup_usage* usage) {
+    for (size_t i = 0; i < paths.size(); i++) {
+        if (i) json.raw(",");
+        json.raw("{\"cgroup\":").string(paths[i].data(), paths[i].size());
+        if (usage[i].error) {
+            json.raw(",\"error\":").number(usage[i].error).raw("}");
+            continue;
+        }
+        json.raw(",\"cpu_usage\":").number(usage[i].cpu_x100)
+            .raw(",\"ram_usage\":").number(usage[i].mem_x100)
+            .raw(",\"cpu_usage_percentage\":").fixed2(usage[i].cpu_x100 / 100.0)
+            .raw(",\"ram_usage_percentage\":").fixed2(usage[i].mem_x100 / 100.0)
+            .raw(",\"cpu_ns\":").number((long long)usage[i].cpu_ns)
+            .raw(",\"interval_ns\":").number((long long)usage[i].interval_ns)
+            .raw(",\"memory_bytes\":").number((long long)usage[i].mem_bytes)
+            .raw(",\"memory_limit_bytes\":").number((long long)usage[i].mem_limit_bytes)
+            .raw("}");
+    }
+}
+
+// --- /stats/events ---
+// En vez de que cada dashboard consulte /stats para ver si se pasó un umbral, un hilo
+// espera en el fd de stats_pressure_open y reenvía cada cruce a los websockets conectados.
+// Umbrales y eventos: mismo layout que en kernel/syscall_pressure.c
+#define PRESSURE_CPU 0
+#define PRESSURE_RAM 1
+struct pressure_threshold {
+    uint32_t resource;
+    uint32_t high_x100;
+    uint32_t low_x100;
+    uint32_t reserved;
+};
+struct pressure_event {
+    uint64_t ts_nsec;
+    uint32_t index;
+    uint32_t resource;
+    uint32_t above;
+    uint32_t value_x100;
+};
+static const char* pressure_resources[] = { "cpu", "ram", "psi_cpu", "psi_mem" };
+
+// Se avisa al pasar el 90% y de nuevo al bajar del 80%
+static const pressure_threshold pressure_thresholds[] = {
+    { PRESSURE_CPU, 9000, 8000, 0 },
+    { PRESSURE_RAM, 9000, 8000, 0 },
+};
+
+static std::mutex events_mutex;
+static std::set<crow::websocket::connection*> events_clients;
+
+static void pressure_relay() {
+    int fd = syscall(SYS_STATS_PRESSURE_OPEN, pressure_thresholds,
+                     sizeof(pressure_thresholds) / sizeof(pressure_thresholds[0]), 1000, O_CLOEXEC);
+    if (fd < 0) {
+        printf("No se pudo abrir stats_pressure_open (Error: %d)\n", -errno);
+        return;
+    }
+
+    pressure_event events[16];
+    char buffer[256];
+    for (;;) {
+        // read() bloquea hasta que el kernel detecta un cruce
+        ssize_t n = read(fd, events, sizeof(events));
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        for (size_t i = 0; i < (size_t)n / sizeof(pressure_event); i++) {
+            const pressure_event& event = events[i];
+            const pressure_threshold& threshold = pressure_thresholds[event.index];
+            JsonWriter json(buffer, sizeof(buffer));
+            json.raw("{\"resource\":\"").raw_dynamic(pressure_resources[event.resource & 3])
+                .raw("\",\"state\":\"").raw_dynamic(event.above ? "above" : "below")
+                .raw("\",\"value\":").fixed2(event.value_x100 / 100.0)
+                .raw(",\"threshold\":").fixed2((event.above ? threshold.high_x100 : threshold.low_x100) / 100.0)
+                .raw(",\"ts_ns\":").number((long long)event.ts_nsec)
+                .raw("}");
+            std::string message(json.data(), json.size());
+
+            std::lock_guard<std::mutex> lock(events_mutex);
+            for (crow::websocket::connection* client : events_clients) {
+                client->send_text(message);
+            }
+        }
+    }
+    close(fd);
+}
+
+// --- /stats, /uptime y /logs ---
+// Fuera de main() para que bench_alloc.cpp pueda llamarlos tal cual los llama crow.
+
+// /stats: uso actual de CPU y RAM (y con ?cgroup= el de cada cgroup pedido)
+static crow::response stats_now(const crow::request& req) {
+    // El kernel escribe un int en cada puntero (ver syscall_cpu_usage.c / syscall_ram_usage.c)
+    int cpu_usage = 0;
+    int ram_usage = 0;
+
+    // ?cgroup=: además, el uso de cada cgroup pedido
+    const char* cgroup_param = req.url_params.get("cgroup");
+    std::vector<std::string> cgroup_paths;
+    cgroup_usage cgroups[CGROUP_USAGE_MAX];
+    if (cgroup_param) {
+        if (!split_cgroup_paths(cgroup_param, cgroup_paths)) {
+            return crow::response(400, "Parametro cgroup invalido (1 a 32 rutas separadas por coma)");
+        }
+        if (read_cgroup_usage(cgroup_paths, cgroups) < 0) {
+            return crow::response(500, "Error al ejecutar la syscall de uso por cgroup (Error: " +
+                                  std::to_string(-errno) + ")");
+        }
+    }
+    
+    // Ejecutamos la syscall
+    long res = syscall(SYS_CPU_USAGE, &cpu_usage);
+
+    if (res != 0) {
+        // Si la syscall falla, devolvemos un error 500
+        return crow::response(500, "Error al ejecutar la syscall de uso de cpu");
+    }
+
+    res = syscall(SYS_RAM_USAGE, &ram_usage);
+    
+    if (res != 0) {
+        // Si la syscall falla, devolvemos un error 500
+        return crow::response(500, "Error al ejecutar la syscall de uso de ram");
+    }
+
+    // Cálculos
+    // Suponiendo que cpu_usage viene en formato XXXX (ej. 1500 = 15.00%)
+    double usage_percentage = cpu_usage / 100.0;
+    double ram_percentage = ram_usage / 100.0;
+
+    // Construimos el JSON de respuesta
+    JsonWriter json(json_buffer, sizeof(json_buffer));
+    json.raw("{\"cpu_usage\":").number(cpu_usage)
+        .raw(",\"ram_usage\":").number(ram_usage)
+        .raw(",\"cpu_usage_percentage\":").fixed2(usage_percentage)
+        .raw(",\"ram_usage_percentage\":").fixed2(ram_percentage);
+    if (cgroup_param) {
+        json.raw(",\"cgroups\":[");
+        write_cgroup_usage(json, cgroup_paths, cgroups);
+        json.raw("]");
+    }
+    json.raw("}");
+    return json_response(json);
+}
+
+// /uptime
+static crow::response uptime_now() {
+    long uptime = syscall(SYS_UPTIME_S);
+    if (uptime < 0) {
+        return crow::response(500, "Error al ejecutar la syscall de uptime");
+    }
+    JsonWriter json(json_buffer, sizeof(json_buffer));
+    json.raw("{\"uptime_seconds\":").number(uptime).raw("}");
+    return json_response(json);
+}
+
+// /logs: ?format=records devuelve un arreglo de mensajes con seq, tiempo y nivel ya separados
+static crow::response kernel_logs(const crow::request& req) {
+    const char* format = req.url_params.get("format");
+    bool records = format && strcmp(format, "records") == 0;
+    int actual_length = 0;
+    // El log se lee al buffer del hilo y se escapa directo a la respuesta, sin copias intermedias
+    int resultLogs = syscall(SYS_KERNEL_LOGS, logs_buffer, LOG_BUFFER_SIZE, &actual_length,
+                             records ? KERNEL_LOGS_RECORDS : KERNEL_LOGS_TEXT);
+    if (resultLogs != 0 || actual_length < 0 || actual_length > LOG_BUFFER_SIZE) {
+        return crow::response(500, "Error al ejecutar la syscall de logs");
+    }
+    JsonWriter json(json_buffer, sizeof(json_buffer));
+
+    if (records) {
+        // Cada registro apunta a su texto dentro del mismo buffer
+        const kernel_log_record* record = (const kernel_log_record*)logs_buffer;
+        json.raw("{\"records\":[");
+        for (int i = 0; i < actual_length; i++, record++) {
+            if ((size_t)(i + 1) * sizeof(*record) > LOG_BUFFER_SIZE ||
+                (size_t)record->text_offset + record->text_len > LOG_BUFFER_SIZE) {
+                return crow::response(500, "Registro de log invalido");
+            }
+            if (i) json.raw(",");
+            json.raw("{\"seq\":").number((long long)record->seq)
+                .raw(",\"ts_ns\":").number((long long)record->ts_nsec)
+                .raw(",\"level\":").number(record->level)
+                .raw(",\"level_name\":\"").raw_dynamic(log_level_names[record->level & 7])
+                .raw("\",\"facility\":").number(record->facility)
+                .raw(",\"text\":").string(logs_buffer + record->text_offset, record->text_len)
+                .raw("}");
+        }
+        json.raw("]}");
+        return json_response(json);
+    }
+
+    // Igual que antes: el log termina en el primer '\0'
+    size_t length = strnlen(logs_buffer, actual_length);
+    json.raw("{\"logs\":").string(logs_buffer, length).raw("}");
+    return json_response(json);
+}
 
 // --- Middleware CORS ---
 struct CORS {
@@ -101,75 +906,50 @@ static bool pam_authenticate_user(const std::string& username,
     return ok;
 }
 
+// bench_alloc.cpp incluye este archivo con su propio main()
+#ifndef API_NO_MAIN
 int main() {
     crow::SimpleApp app;
     // Endpoint: /stats
-    CROW_ROUTE(app, "/stats")([](){
-        short cpu_usage = 0;
-        short ram_usage = 0;
-        
-        // Ejecutamos la syscall
-        long res = syscall(SYS_CPU_USAGE, &cpu_usage);
-
-        if (res != 0) {
-            // Si la syscall falla, devolvemos un error 500
-            return crow::response(500, "Error al ejecutar la syscall de uso de cpu");
-        }
-
-        res = syscall(SYS_RAM_USAGE, &ram_usage);
-        
-        if (res != 0) {
-            // Si la syscall falla, devolvemos un error 500
-            return crow::response(500, "Error al ejecutar la syscall de uso de ram");
-        }
+    CROW_ROUTE(app, "/stats")([](const crow::request& req){
+        return stats_now(req);
+    });
 
-        // Cálculos
-        // Suponiendo que cpu_usage viene en formato XXXX (ej. 1500 = 15.00%)
-        float usage_percentage = cpu_usage / 100.0;
-        float ram_percentage = ram_usage / 100.0;
+    // endpoint: /stats/history (tendencias sin consultar a un TSDB externo)
+    CROW_ROUTE(app, "/stats/history")([](const crow::request& req){
+        return stats_history(req);
+    });
 
-        // Construimos el JSON de respuesta
-        crow::json::wvalue response;
-        response["cpu_usage"] = cpu_usage;
-        response["ram_usage"] = ram_usage;
-        response["cpu_usage_percentage"] = usage_percentage;
-        response["ram_usage_percentage"] = ram_percentage;
-        return crow::response(response);
-        
+    // endpoint: /stats/top (procesos que más CPU y memoria usan)
+    CROW_ROUTE(app, "/stats/top")([](const crow::request& req){
+        return stats_top(req);
     });
 
+    // endpoint: /stats/events (websocket: avisos de CPU/RAM por encima del umbral)
+    CROW_WEBSOCKET_ROUTE(app, "/stats/events")
+        .onopen([](crow::websocket::connection& conn){
+            std::lock_guard<std::mutex> lock(events_mutex);
+            events_clients.insert(&conn);
+        })
+        .onclose([](crow::websocket::connection& conn, auto&&...){
+            std::lock_guard<std::mutex> lock(events_mutex);
+            events_clients.erase(&conn);
+        });
+
     // endpoint: /uptime
     CROW_ROUTE(app, "/uptime")([](){
-        unsigned int uptime = syscall(SYS_UPTIME_S);
-        if (uptime < 0) {
-            return crow::response(500, "Error al ejecutar la syscall de uptime");
-        }
-        crow::json::wvalue response;
-        response["uptime_seconds"] = uptime;
-        return crow::response(response);
+        return uptime_now();
     });
 
     //endpoint: /logs
-    CROW_ROUTE(app, "/logs")([](){
-        #define LOG_BUFFER_SIZE 1024*4
-        char logs_buffer[LOG_BUFFER_SIZE];
-        int actual_length = 0;
-        //Inicialr el buffer para evitar basura en la memoria 
-        memset(logs_buffer, 0, LOG_BUFFER_SIZE);
-        int resultLogs = syscall(SYS_KERNEL_LOGS, logs_buffer, LOG_BUFFER_SIZE, &actual_length);
-        if (resultLogs != 0) {
-            return crow::response(500, "Error al ejecutar la syscall de logs");
-        }
-        logs_buffer[actual_length] = '\0'; // Asegurar que el buffer este null-terminated
-        crow::json::wvalue response;
-        response["logs"] = std::string(logs_buffer);
-        return crow::response(response);
+    CROW_ROUTE(app, "/logs")([](const crow::request& req){
+        return kernel_logs(req);
     });
 
     //endpoint: /encrypt
     CROW_ROUTE(app, "/encrypt").methods(crow::HTTPMethod::POST)([](const crow::request& req){
         auto body = crow::json::load(req.body);
-        if (!body || !body.has("file_input") || !body.has("file_output") || !body.has("key") || !body.has("threads")) {
+        if (!body || !body.has("file_input") || !body.has("file_output") || !body.has("key")) {
             return crow::response(400, "Invalid JSON");
         }
 
@@ -177,24 +957,45 @@ int main() {
         std::string raw_input = body["file_input"].s();
         std::string raw_output = body["file_output"].s();
         std::string raw_key = body["key"].s();
-        int threads = body["threads"].i();
+        // "threads" es opcional: sin él (o con 0) el kernel elige según el tamaño y la carga
+        int threads = body.has("threads") ? (int)body["threads"].i() : 0;
+        if (threads < 0) {
+            return crow::response(400, "Numero de hilos invalido");
+        }
+        int mode = parse_crypt_mode(body);
+        if (mode < 0) {
+            return crow::response(400, "Modo de cifrado invalido (xor | chacha20)");
+        }
+        mode |= parse_crypt_flags(body);
+        // "checksum": true devuelve el CRC32C del archivo cifrado (calculado al cifrar, sin releerlo)
+        bool want_checksum = body.has("checksum") && body["checksum"].b();
+        uint32_t checksum = 0;
 
         // Ahora usamos filesystem::absolute con los std::string
         std::string file_input = std::filesystem::absolute(raw_input).string();
         std::string file_output = std::filesystem::absolute(raw_output).string();
         std::string key_path = std::filesystem::absolute(raw_key).string();
 
+        // Trabajo en segundo plano: se consulta/cancela en /jobs/<job_id>
+        if (body.has("async") && body["async"].b()) {
+            crow::json::wvalue response;
+            response["job_id"] = start_crypt_job(SYS_MY_ENCRYPT, file_input, file_output, key_path, threads, mode,
+                                                 want_checksum, 0);
+            return crow::response(202, response.dump());
+        }
+
         // Llamada a la syscall usando los paths absolutos
-        long result = syscall(SYS_MY_ENCRYPT, file_input, file_output, key_path, threads);
+        long result = syscall(SYS_MY_ENCRYPT, file_input.c_str(), file_output.c_str(), key_path.c_str(), threads, mode,
+                              want_checksum ? &checksum : nullptr);
+        if (result < 0) result = -errno; // Antes de armar el JSON, que puede pisar errno
 
         crow::json::wvalue response;
         response["result"] = result;
         if (result >= 0){
             response["message"] = "Archivo encriptado exitosamente";
+            if (want_checksum) response["checksum"] = checksum_to_hex(checksum);
         } else {
             response["message"] = "Ocurrió un error en el kernel (Error: " + std::to_string(result) + ")";
-            // Imprimimos para depurar qué rutas se están enviando exactamente
-            printf("DEBUG - Input path: %s\n", file_input.c_str());
         }
         return crow::response(response);
     });
@@ -202,34 +1003,164 @@ int main() {
     //endpoint: /decrypt
     CROW_ROUTE(app, "/decrypt").methods(crow::HTTPMethod::POST)([](const crow::request& req){
         auto body = crow::json::load(req.body);
-        if (!body || !body.has("file_input") || !body.has("file_output") || !body.has("key") || !body.has("threads")) {
+        if (!body || !body.has("file_input") || !body.has("file_output") || !body.has("key")) {
             return crow::response(400, "Invalid JSON");
         }
         // Convertimos primero a std::string explícitamente
         std::string raw_input = body["file_input"].s();
         std::string raw_output = body["file_output"].s();
         std::string raw_key = body["key"].s();
-        int threads = body["threads"].i();
+        // "threads" es opcional: sin él (o con 0) el kernel elige según el tamaño y la carga
+        int threads = body.has("threads") ? (int)body["threads"].i() : 0;
+        if (threads < 0) {
+            return crow::response(400, "Numero de hilos invalido");
+        }
+        int mode = parse_crypt_mode(body);
+        if (mode < 0) {
+            return crow::response(400, "Modo de cifrado invalido (xor | chacha20)");
+        }
+        mode |= parse_crypt_flags(body);
+        // "verify": "<checksum de /encrypt>" comprueba el archivo mientras se descifra;
+        // si no coincide el kernel borra la salida. "checksum": true solo lo devuelve.
+        uint32_t checksum = 0;
+        bool want_checksum = body.has("checksum") && body["checksum"].b();
+        if (body.has("verify")) {
+            if (!checksum_from_hex(body["verify"].s(), &checksum)) {
+                return crow::response(400, "Checksum invalido (8 digitos hexadecimales)");
+            }
+            mode |= CRYPT_FLAG_VERIFY;
+            want_checksum = true;
+        }
         // Ahora usamos filesystem::absolute con los std::string
         std::string file_input = std::filesystem::absolute(raw_input).string();
         std::string file_output = std::filesystem::absolute(raw_output).string();
         std::string key_path = std::filesystem::absolute(raw_key).string();
 
-        long result = syscall(SYS_MY_DECRYPT,  file_input.c_str(), file_output.c_str(), key_path.c_str(), threads);
+        // Trabajo en segundo plano: se consulta/cancela en /jobs/<job_id>
+        if (body.has("async") && body["async"].b()) {
+            crow::json::wvalue response;
+            response["job_id"] = start_crypt_job(SYS_MY_DECRYPT, file_input, file_output, key_path, threads, mode,
+                                                 want_checksum, checksum);
+            return crow::response(202, response.dump());
+        }
+
+        long result = syscall(SYS_MY_DECRYPT,  file_input.c_str(), file_output.c_str(), key_path.c_str(), threads, mode,
+                              want_checksum ? &checksum : nullptr);
+        if (result < 0) result = -errno; // Antes de armar el JSON, que puede pisar errno
         crow::json::wvalue response;
         
         response["result"] = result;
         if (result >= 0){
             response["message"] = "Archivo desencriptado exitosamente";
+            if (want_checksum) response["checksum"] = checksum_to_hex(checksum);
+        } else if (result == -EBADMSG && (mode & CRYPT_FLAG_VERIFY)) {
+            response["message"] = "El checksum no coincide: el archivo cifrado está dañado";
         } else {
             response["message"] = "Ocurrió un error en el kernel (Error: " + std::to_string(result) + ")";
         }
         return crow::response(response);
     });
 
+    //endpoint: /encrypt/inline y /decrypt/inline (buffer a buffer, sin archivos)
+    CROW_ROUTE(app, "/encrypt/inline").methods(crow::HTTPMethod::POST)([](const crow::request& req){
+        return crypt_inline(req, false);
+    });
+    CROW_ROUTE(app, "/decrypt/inline").methods(crow::HTTPMethod::POST)([](const crow::request& req){
+        return crypt_inline(req, true);
+    });
+
+    //endpoint: /decrypt/range
+    // Descifra solo [offset, offset + length) y devuelve los bytes tal cual
+    CROW_ROUTE(app, "/decrypt/range").methods(crow::HTTPMethod::POST)([](const crow::request& req){
+        #define RANGE_MAX_LENGTH (16 * 1024 * 1024)
+        auto body = crow::json::load(req.body);
+        if (!body || !body.has("file_input") || !body.has("key") || !body.has("offset") || !body.has("length")) {
+            return crow::response(400, "Invalid JSON");
+        }
+        int mode = parse_crypt_mode(body);
+        if (mode < 0) {
+            return crow::response(400, "Modo de cifrado invalido (xor | chacha20)");
+        }
+        long long offset = body["offset"].i();
+        long long length = body["length"].i();
+        if (offset < 0 || length <= 0 || length > RANGE_MAX_LENGTH) {
+            return crow::response(400, "Rango invalido");
+        }
+
+        std::string file_input = std::filesystem::absolute(std::string(body["file_input"].s())).string();
+        std::string key_path = std::filesystem::absolute(std::string(body["key"].s())).string();
+
+        std::string data(length, '\0');
+        long result = syscall(SYS_MY_DECRYPT_RANGE, file_input.c_str(), key_path.c_str(),
+                              (off_t)offset, (size_t)length, &data[0], mode);
+        if (result < 0) {
+            // syscall() devuelve -1 y deja el código real en errno
+            return crow::response(500, "Ocurrió un error en el kernel (Error: " + std::to_string(-errno) + ")");
+        }
+        // La syscall recorta el rango si pasa el final de los datos
+        data.resize(result);
+
+        crow::response res(200, data);
+        res.set_header("Content-Type", "application/octet-stream");
+        return res;
+    });
+
+    //endpoint: /jobs/<id>
+    // GET: avance del trabajo (o su resultado si ya terminó). DELETE: lo cancela.
+    CROW_ROUTE(app, "/jobs/<int>").methods(crow::HTTPMethod::GET, crow::HTTPMethod::DELETE)([](const crow::request& req, int id){
+        std::shared_ptr<CryptJob> job;
+        crow::json::wvalue response;
+        {
+            std::lock_guard<std::mutex> lock(jobs_mutex);
+            prune_jobs();
+            auto it = jobs.find(id);
+            if (it == jobs.end()) {
+                return crow::response(404, "Trabajo no encontrado");
+            }
+            job = it->second;
+            if (job->done) {
+                response["state"] = "done";
+                response["result"] = job->result;
+                if (job->has_checksum) response["checksum"] = checksum_to_hex(job->checksum);
+                if (req.method == crow::HTTPMethod::GET) jobs.erase(it); // El resultado se entrega una vez
+                return crow::response(response);
+            }
+        }
+
+        if (req.method == crow::HTTPMethod::DELETE) {
+            if (syscall(SYS_CRYPT_JOB_CTL, (pid_t)id, CRYPT_JOB_CANCEL, nullptr) < 0 && errno != ESRCH) {
+                return crow::response(500, "Ocurrió un error en el kernel (Error: " + std::to_string(-errno) + ")");
+            }
+            response["state"] = "cancelling";
+            return crow::response(202, response.dump());
+        }
+
+        crypt_job_status status{};
+        if (syscall(SYS_CRYPT_JOB_CTL, (pid_t)id, CRYPT_JOB_QUERY, &status) < 0) {
+            if (errno != ESRCH) {
+                return crow::response(500, "Ocurrió un error en el kernel (Error: " + std::to_string(-errno) + ")");
+            }
+            // Todavía abriendo archivos o terminando: el kernel no lo tiene registrado
+            response["state"] = "running";
+            return crow::response(response);
+        }
+        response["state"] = status.cancelled ? "cancelling" : "running";
+        response["phase"] = status.phase < 3 ? crypt_job_phases[status.phase] : "unknown";
+        response["bytes_total"] = status.bytes_total;
+        response["bytes_done"] = status.bytes_done;
+        response["progress"] = status.bytes_total ? (double)status.bytes_done * 100.0 / status.bytes_total : 0.0;
+        return crow::response(response);
+    });
+
+    // Muestreo de /stats/history: corre mientras viva el proceso
+    std::thread(stats_sampler).detach();
+    // Avisos de presión para /stats/events
+    std::thread(pressure_relay).detach();
+
     app.port(18080).multithreaded().run();
     return 0;
 }
+#endif
 
 /* 
 
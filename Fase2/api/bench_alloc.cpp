@@ -0,0 +1,181 @@
+// Fase2/api/bench_alloc.cpp
+// Cuenta las reservas del heap que hace cada pedido a /stats, /uptime y /logs, antes y
+// después de JsonWriter. Reemplaza el operator new global por uno que cuenta y mide:
+// - antes: los handlers como estaban, armando un crow::json::wvalue (copiados abajo,
+//   legacy_*)
+// - después: los mismos handlers que usa crow (stats_now, uptime_now, kernel_logs de api.cpp)
+// - la respuesta sola: lo que reserva json_response con un cuerpo del mismo tamaño (el
+//   std::string de crow::response y el header Content-Type). Eso no se puede evitar
+//   mientras crow guarde el cuerpo en un std::string.
+// "handler" es lo que reserva el handler además de la respuesta: después tiene que ser 0.
+//
+// Compilar: g++ -O2 -std=c++17 bench_alloc.cpp -o bench_alloc -lpthread -lpam -lpam_misc
+// (avisa de funciones de api.cpp sin usar: acá no hay rutas, es esperable)
+// Ejecutar (en el kernel con las syscalls): ./bench_alloc [pedidos por endpoint]
+// Retorna 1 si algún handler reserva memoria aparte de la respuesta, o más que antes.
+#define API_NO_MAIN
+#include "api.cpp"
+
+#include <new>
+#include <cstdlib>
+
+// Solo se cuenta en el hilo que mide, y solo mientras mide
+static thread_local bool counting = false;
+static thread_local unsigned long allocations = 0;
+
+void* operator new(size_t size) {
+    if (counting) allocations++;
+    if (void* ptr = malloc(size ? size : 1)) return ptr;
+    throw std::bad_alloc();
+}
+void operator delete(void* ptr) noexcept { free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { free(ptr); }
+// new[] y delete[] por defecto pasan por los de arriba
+
+// --- Antes: los handlers armando un crow::json::wvalue ---
+// Igual que antes de JsonWriter, salvo que cpu_usage/ram_usage reciben un int (antes un
+// short, y el kernel escribía 4 bytes en él).
+static crow::response legacy_stats() {
+    int cpu_usage = 0;
+    int ram_usage = 0;
+    if (syscall(SYS_CPU_USAGE, &cpu_usage) != 0) {
+        return crow::response(500, "Error al ejecutar la syscall de uso de cpu");
+    }
+    if (syscall(SYS_RAM_USAGE, &ram_usage) != 0) {
+        return crow::response(500, "Error al ejecutar la syscall de uso de ram");
+    }
+    crow::json::wvalue response;
+    response["cpu_usage"] = cpu_usage;
+    response["ram_usage"] = ram_usage;
+    response["cpu_usage_percentage"] = (float)(cpu_usage / 100.0);
+    response["ram_usage_percentage"] = (float)(ram_usage / 100.0);
+    return crow::response(response);
+}
+
+static crow::response legacy_uptime() {
+    long uptime = syscall(SYS_UPTIME_S);
+    if (uptime < 0) {
+        return crow::response(500, "Error al ejecutar la syscall de uptime");
+    }
+    crow::json::wvalue response;
+    response["uptime_seconds"] = uptime;
+    return crow::response(response);
+}
+
+static crow::response legacy_logs() {
+    char logs_buffer[LOG_BUFFER_SIZE];
+    int actual_length = 0;
+    memset(logs_buffer, 0, LOG_BUFFER_SIZE);
+    int resultLogs = syscall(SYS_KERNEL_LOGS, logs_buffer, LOG_BUFFER_SIZE, &actual_length, KERNEL_LOGS_TEXT);
+    if (resultLogs != 0 || actual_length < 0 || actual_length >= LOG_BUFFER_SIZE) {
+        return crow::response(500, "Error al ejecutar la syscall de logs");
+    }
+    logs_buffer[actual_length] = '\0';
+    crow::json::wvalue response;
+    response["logs"] = std::string(logs_buffer);
+    return crow::response(response);
+}
+
+// --- Medición ---
+template <typename F>
+static unsigned long count_allocations(F&& fn) {
+    allocations = 0;
+    counting = true;
+    fn();
+    counting = false;
+    return allocations;
+}
+
+struct Measure {
+    bool ok = false;
+    double per_request = 0;       // Reservas por pedido
+    long long ns = 0;             // Tiempo por pedido
+    size_t bytes = 0;             // Tamaño del cuerpo
+};
+
+// Mide 'handler' 'iterations' veces
+template <typename F>
+static Measure measure(const char* name, F&& handler, int iterations) {
+    Measure m;
+
+    // La primera llamada no cuenta: inicializa los buffers thread_local y lo que libc
+    // reserva una sola vez (ej. el locale de snprintf)
+    crow::response first = handler();
+    if (first.code != 200) {
+        printf("%-22s la syscall falló (%d): %s\n", name, first.code, first.body.c_str());
+        return m;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    unsigned long total = count_allocations([&] {
+        for (int i = 0; i < iterations; i++) {
+            crow::response res = handler();
+        }
+    });
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+
+    m.ok = true;
+    m.per_request = (double)total / iterations;
+    m.ns = elapsed.count() / iterations;
+    m.bytes = first.body.size();
+    return m;
+}
+
+// Lo que cuesta crow::response solo (json_response), con un cuerpo de 'bytes' bytes
+static unsigned long response_allocations(size_t bytes) {
+    static char baseline_buffer[JSON_BUFFER_SIZE];
+    static char filler[JSON_BUFFER_SIZE];
+
+    memset(filler, 'x', sizeof(filler) - 1);
+    JsonWriter baseline(baseline_buffer, sizeof(baseline_buffer));
+    baseline.raw_dynamic(filler + sizeof(filler) - 1 - std::min(bytes, sizeof(filler) - 1));
+    return count_allocations([&] { crow::response res = json_response(baseline); });
+}
+
+// Antes contra después. Retorna false si después el handler reserva más que su
+// respuesta, o más que antes. 'before' puede no existir (formato nuevo).
+template <typename Before, typename After>
+static bool compare(const char* name, Before&& before, After&& after, int iterations) {
+    Measure now = measure(name, after, iterations);
+    if (!now.ok) return false;
+    unsigned long response_allocs = response_allocations(now.bytes);
+    double extra = now.per_request - (double)response_allocs;
+
+    printf("%-22s después: %8.2f reservas/pedido (respuesta: %lu, handler: %+.2f)  %10lld ns/pedido  %zu bytes\n",
+           name, now.per_request, response_allocs, extra, now.ns, now.bytes);
+
+    bool ok = extra <= 0.0;
+    Measure old = before(iterations);
+    if (old.ok) {
+        printf("%-22s antes:   %8.2f reservas/pedido                             %10lld ns/pedido  %zu bytes\n",
+               "", old.per_request, old.ns, old.bytes);
+        ok &= now.per_request <= old.per_request;
+    }
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    int iterations = argc > 1 ? atoi(argv[1]) : 200;
+    if (iterations <= 0) {
+        fprintf(stderr, "Uso: %s [pedidos por endpoint]\n", argv[0]);
+        return 2;
+    }
+
+    crow::request plain, records;
+    records.url_params = crow::query_string("/logs?format=records");
+    auto none = [](int) { return Measure(); };
+
+    bool ok = true;
+    ok &= compare("/stats", [](int n) { return measure("/stats (antes)", legacy_stats, n); },
+                  [&] { return stats_now(plain); }, iterations);
+    ok &= compare("/uptime", [](int n) { return measure("/uptime (antes)", legacy_uptime, n); },
+                  [] { return uptime_now(); }, iterations);
+    ok &= compare("/logs", [](int n) { return measure("/logs (antes)", legacy_logs, n); },
+                  [&] { return kernel_logs(plain); }, iterations);
+    // format=records no existía antes de JsonWriter: solo se mide contra la respuesta
+    ok &= compare("/logs?format=records", none, [&] { return kernel_logs(records); }, iterations);
+
+    printf(ok ? "OK: los handlers no reservan memoria fuera de crow::response, ni más que antes\n"
+              : "FALLO: algún handler reserva memoria fuera de crow::response, o más que antes\n");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,290 @@
+// kernel/syscall_cgroup_usage.c
+// Uso de CPU y memoria de uno o varios cgroups (v2) en una sola llamada.
+// En un host con contenedores cpu_usage / ram_usage miden la máquina entera; esta
+// syscall mide lo que usa cada cgroup y contra qué límite.
+#include <linux/kernel.h>
+#include <linux/syscalls.h>
+#include <linux/uaccess.h>
+#include <linux/cgroup.h>
+#include <linux/memcontrol.h>
+#include <linux/page_counter.h>
+#include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/err.h>
+#include <linux/mutex.h>
+#include <linux/rcupdate.h>
+#include <linux/delay.h>
+#include <linux/cpumask.h>
+#include <linux/timekeeping.h>
+#include "syscall_cpu_usage.h"
+#include "syscall_ram_usage.h"
+
+// Un cgroup pedido: el usuario llena fd o path y el kernel el resto (64 bytes)
+struct cgroup_usage {
+    __s32 fd;                     // fd del directorio del cgroup, o -1 para usar 'path'
+    __s32 error;                  // 0, o el error de este cgroup (los demás se miden igual);
+                                  // -EOPNOTSUPP: no tiene habilitado el controlador memory;
+                                  // -EAGAIN: (raíz) cpu_usage todavía no tiene una muestra
+    __u64 path;                   // (const char *) ruta dentro de la jerarquía v2, ej: "/system.slice"
+    __u64 cpu_ns;                 // Tiempo de CPU del cgroup en el intervalo
+    __u64 interval_ns;            // Intervalo medido
+    __u64 mem_bytes;              // memory.current
+    __u64 mem_limit_bytes;        // El menor memory.max del cgroup y sus ancestros, o la RAM total
+    __u32 cpu_x100;               // CPU usada, % de la máquina x100 (0 a 10000, como cpu_usage)
+    __u32 mem_x100;               // mem_bytes contra mem_limit_bytes (0 a 10000, como ram_usage)
+    __u64 reserved;               // 0
+};
+static_assert(sizeof(struct cgroup_usage) == 64);
+
+#define CGROUP_USAGE_MAX 32
+// Igual que top_tasks: si la muestra anterior es más vieja que esto se mide 100ms
+#define CGROUP_SAMPLE_MAX_AGE (5ULL * NSEC_PER_SEC)
+#define CGROUP_SAMPLES 64         // Cgroups recordados entre llamadas
+
+#ifdef CONFIG_CGROUPS
+// Muestra anterior de cada cgroup (por id), contra la que se calcula el delta de CPU
+struct cgroup_sample {
+    u64 id;
+    u64 runtime;
+    u64 ns;                       // 0 = entrada libre
+};
+static DEFINE_MUTEX(cgroup_sample_lock);
+static struct cgroup_sample cgroup_samples[CGROUP_SAMPLES];
+
+// Retorna la muestra del cgroup o, si no está, la entrada más vieja para reemplazarla
+static struct cgroup_sample *cgroup_sample_find(u64 id, bool *found)
+{
+    struct cgroup_sample *oldest = &cgroup_samples[0];
+    int i;
+
+    for (i = 0; i < CGROUP_SAMPLES; i++) {
+        if (cgroup_samples[i].ns && cgroup_samples[i].id == id) {
+            *found = true;
+            return &cgroup_samples[i];
+        }
+        if (cgroup_samples[i].ns < oldest->ns)
+            oldest = &cgroup_samples[i];
+    }
+    *found = false;
+    return oldest;
+}
+
+// Tiempo de CPU acumulado por el cgroup y sus descendientes (lo mismo que usage_usec de cpu.stat)
+static u64 cgroup_runtime(struct cgroup *cgrp)
+{
+    cgroup_rstat_flush(cgrp);
+    return READ_ONCE(cgrp->bstat.cputime.sum_exec_runtime);
+}
+
+// Memoria del propio cgroup. Si no tiene habilitado el controlador memory no lleva
+// memory.current y se retorna -EOPNOTSUPP: el css "efectivo" (cgroup_get_e_css)
+// sería el de un ancestro, y se reportaría lo que usan él y todos sus hijos juntos.
+static int cgroup_memory(struct cgroup *cgrp, struct cgroup_usage *usage)
+{
+#ifdef CONFIG_MEMCG
+    unsigned long limit = totalram_pages(), pages;
+    struct cgroup_subsys_state *css;
+    struct mem_cgroup *memcg;
+
+    rcu_read_lock();
+    css = rcu_dereference(cgrp->subsys[memory_cgrp_id]);
+    if (css && !css_tryget_online(css))
+        css = NULL;
+    rcu_read_unlock();
+    if (!css)
+        return -EOPNOTSUPP;
+
+    memcg = mem_cgroup_from_css(css);
+    pages = page_counter_read(&memcg->memory);
+    // memory.max no se hereda, pero el de un ancestro también limita a este cgroup
+    for (; memcg; memcg = parent_mem_cgroup(memcg))
+        limit = min(limit, READ_ONCE(memcg->memory.max));
+    css_put(css);
+
+    usage->mem_bytes = (u64)pages << PAGE_SHIFT;
+    usage->mem_limit_bytes = (u64)limit << PAGE_SHIFT;
+    usage->mem_x100 = limit ? (u32)min_t(u64, div64_u64((u64)pages * 10000ULL, limit), 10000) : 0;
+    return 0;
+#else
+    return -EOPNOTSUPP;
+#endif
+}
+
+static struct cgroup *cgroup_usage_get(const struct cgroup_usage *usage)
+{
+    struct cgroup *cgrp;
+    char *path;
+
+    if (usage->fd >= 0)
+        return cgroup_get_from_fd(usage->fd);
+    if (!usage->path)
+        return ERR_PTR(-EINVAL);
+
+    path = strndup_user(u64_to_user_ptr(usage->path), PATH_MAX);
+    if (IS_ERR(path))
+        return ERR_CAST(path);
+    cgrp = cgroup_get_from_path(path);
+    kfree(path);
+    return cgrp;
+}
+#endif
+
+/*
+ * SYSCALL_DEFINE2: cgroup_usage
+ * - usage: arreglo de 'count' struct cgroup_usage; se lee fd/path y se escribe el resto
+ * - count: cuántos cgroups (1 a CGROUP_USAGE_MAX)
+ * La CPU se mide desde la consulta anterior de ese mismo cgroup. Si no hubo una en
+ * los últimos 5 segundos se mide durante 100ms (una sola espera para todo el arreglo,
+ * sin tener tomado el lock de las muestras: las demás llamadas no esperan por esta).
+ * El cgroup raíz no lleva estas cuentas: para él se retornan cpu_usage y ram_usage
+ * (solo cpu_x100 y mem_x100; el resto queda en 0).
+ * Retorna cuántos cgroups se midieron sin error.
+ */
+SYSCALL_DEFINE2(cgroup_usage, struct cgroup_usage __user *, usage, unsigned int, count) {
+#ifdef CONFIG_CGROUPS
+    struct cgroup_usage *entries;
+    struct cgroup **cgroups;
+    struct cgroup_sample *sample;
+    u64 *runtimes, *stamps, runtime, now;
+    bool found, wait = false;
+    unsigned int i, measured = 0;
+    long ret_val;
+
+    // 1. VALIDACIONES
+    if (!usage || count == 0 || count > CGROUP_USAGE_MAX)
+        return -EINVAL;
+
+    entries = kmalloc_array(count, sizeof(*entries), GFP_KERNEL);
+    cgroups = kcalloc(count, sizeof(*cgroups), GFP_KERNEL);
+    runtimes = kcalloc(count, sizeof(*runtimes), GFP_KERNEL);
+    stamps = kcalloc(count, sizeof(*stamps), GFP_KERNEL);
+    if (!entries || !cgroups || !runtimes || !stamps) {
+        ret_val = -ENOMEM;
+        goto free_memory;
+    }
+    if (copy_from_user(entries, usage, count * sizeof(*entries))) {
+        ret_val = -EFAULT;
+        goto free_memory;
+    }
+    // De lo copiado solo valen fd, path y reserved: lo que el kernel escribe empieza
+    // en 0, así una entrada con error (o la raíz) no devuelve lo que trajo el usuario
+    for (i = 0; i < count; i++) {
+        entries[i].error = 0;
+        entries[i].cpu_ns = 0;
+        entries[i].interval_ns = 0;
+        entries[i].mem_bytes = 0;
+        entries[i].mem_limit_bytes = 0;
+        entries[i].cpu_x100 = 0;
+        entries[i].mem_x100 = 0;
+    }
+
+    // 2. RESOLVER CADA CGROUP (un fd o ruta inválida solo marca su entrada)
+    for (i = 0; i < count; i++) {
+        if (entries[i].reserved) {
+            ret_val = -EINVAL;
+            goto put_cgroups;
+        }
+        cgroups[i] = cgroup_usage_get(&entries[i]);
+        entries[i].error = IS_ERR(cgroups[i]) ? PTR_ERR(cgroups[i]) : 0;
+        if (IS_ERR(cgroups[i]))
+            cgroups[i] = NULL;
+    }
+
+    // 3. CPU: LA MUESTRA ANTERIOR DE CADA CGROUP (o una nueva si es muy vieja)
+    // Se copia a runtimes/stamps: mientras se duerme otra llamada puede reemplazarla
+    if (mutex_lock_killable(&cgroup_sample_lock)) {
+        ret_val = -EINTR;
+        goto put_cgroups;
+    }
+    now = ktime_get_ns();
+    for (i = 0; i < count; i++) {
+        if (!cgroups[i])
+            continue;
+        // La raíz usa la muestra de cpu_usage: si no hay una reciente, esta deja la
+        // inicial y la espera de abajo le da el intervalo
+        if (!cgroup_parent(cgroups[i])) {
+            if (cpu_usage_recent_x100() == CPU_USAGE_UNKNOWN)
+                wait = true;
+            continue;
+        }
+        runtime = cgroup_runtime(cgroups[i]);
+        sample = cgroup_sample_find(cgroup_id(cgroups[i]), &found);
+        if (!found || now - sample->ns > CGROUP_SAMPLE_MAX_AGE) {
+            sample->id = cgroup_id(cgroups[i]);
+            sample->runtime = runtime;
+            sample->ns = now;
+            wait = true;
+        }
+        runtimes[i] = sample->runtime;
+        stamps[i] = sample->ns;
+    }
+    mutex_unlock(&cgroup_sample_lock);
+
+    // La espera va sin el lock, si no cada llamada concurrente esperaría 100ms más
+    if (wait)
+        msleep(100);
+
+    // 4. CPU: DELTA CONTRA ESA MUESTRA, Y QUEDA LA ACTUAL PARA LA PRÓXIMA LLAMADA
+    if (mutex_lock_killable(&cgroup_sample_lock)) {
+        ret_val = -EINTR;
+        goto put_cgroups;
+    }
+    now = ktime_get_ns();
+    for (i = 0; i < count; i++) {
+        if (!cgroups[i])
+            continue;
+        if (!cgroup_parent(cgroups[i])) {
+            entries[i].cpu_x100 = cpu_usage_recent_x100();
+            if (entries[i].cpu_x100 == CPU_USAGE_UNKNOWN) {
+                entries[i].cpu_x100 = 0;
+                entries[i].error = -EAGAIN;
+            }
+            entries[i].mem_x100 = ram_usage_x100();
+            continue;
+        }
+        runtime = cgroup_runtime(cgroups[i]);
+        if (now > stamps[i]) {
+            entries[i].interval_ns = now - stamps[i];
+            entries[i].cpu_ns = runtime > runtimes[i] ? runtime - runtimes[i] : 0;
+            entries[i].cpu_x100 = (u32)min_t(u64, div64_u64(entries[i].cpu_ns * 10000ULL,
+                                             entries[i].interval_ns * num_online_cpus()), 10000);
+        }
+        sample = cgroup_sample_find(cgroup_id(cgroups[i]), &found);
+        sample->id = cgroup_id(cgroups[i]);
+        sample->runtime = runtime;
+        sample->ns = now;
+    }
+    mutex_unlock(&cgroup_sample_lock);
+
+    // 5. MEMORIA (un cgroup sin el controlador memory queda con su error)
+    for (i = 0; i < count; i++) {
+        if (!cgroups[i])
+            continue;
+        if (cgroup_parent(cgroups[i]))
+            entries[i].error = cgroup_memory(cgroups[i], &entries[i]);
+        if (!entries[i].error)
+            measured++;
+    }
+
+    if (copy_to_user(usage, entries, count * sizeof(*entries))) {
+        ret_val = -EFAULT;
+        goto put_cgroups;
+    }
+    ret_val = measured;
+
+put_cgroups:
+    for (i = 0; i < count; i++) {
+        if (cgroups[i])
+            cgroup_put(cgroups[i]);
+    }
+free_memory:
+    kfree(stamps);
+    kfree(runtimes);
+    kfree(cgroups);
+    kfree(entries);
+    return ret_val;
+#else
+    return -EOPNOTSUPP;
+#endif
+}
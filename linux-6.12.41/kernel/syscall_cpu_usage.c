@@ -5,6 +5,9 @@
 #include <linux/kernel_stat.h> // Necesario para acceder a kcpustat_cpu()
 #include <linux/sched/cputime.h>
 #include <linux/cpumask.h>
+#include <linux/spinlock.h>
+#include <linux/jiffies.h>
+#include "syscall_cpu_usage.h"
 
 /*
  * Helper: read_cpu_times 
@@ -76,6 +79,69 @@ static u32 get_cpu_percent_x100(void)
     return (u32)div64_u64((u64)(dtotal - didle) * 10000ULL, (u64)dtotal);
 }
 
+// Última muestra tomada por cpu_usage_recent_x100
+static DEFINE_SPINLOCK(cpu_sample_lock);
+static u64 sample_idle, sample_total;
+static unsigned long sample_jiffies;
+static bool sample_taken;
+static u32 sample_percent = CPU_USAGE_UNKNOWN;
+
+// Intervalo mínimo entre muestras: más seguido la diferencia es puro ruido
+#define CPU_SAMPLE_MIN_INTERVAL (HZ / 10) // 100ms, igual que get_cpu_percent_x100
+// Intervalo máximo: contra una muestra más vieja el promedio ya no dice cómo está
+// la máquina ahora (después de un minuto quieto, una carga que empezó hace 1s no se ve)
+#define CPU_SAMPLE_MAX_INTERVAL HZ        // 1s
+
+/*
+ * cpu_usage_recent_x100
+ * Igual que get_cpu_percent_x100 pero sin bloquear: el intervalo es el tiempo
+ * desde la muestra anterior, entre 100ms y 1s. Si pasaron menos de 100ms se
+ * retorna el último valor calculado. Sin muestra anterior, o con una de más de
+ * 1s, retorna CPU_USAGE_UNKNOWN (y la muestra de ahora sirve para la próxima).
+ */
+u32 cpu_usage_recent_x100(void)
+{
+    u64 idle, total;
+    u32 percent;
+
+    read_cpu_times(&idle, &total);
+
+    spin_lock(&cpu_sample_lock);
+    if (!sample_taken || time_after_eq(jiffies, sample_jiffies + CPU_SAMPLE_MIN_INTERVAL)) {
+        if (sample_taken && time_before_eq(jiffies, sample_jiffies + CPU_SAMPLE_MAX_INTERVAL) &&
+            total > sample_total && total - sample_total >= idle - sample_idle)
+            sample_percent = (u32)div64_u64((total - sample_total - (idle - sample_idle)) * 10000ULL,
+                                            total - sample_total);
+        else
+            sample_percent = CPU_USAGE_UNKNOWN;
+        sample_taken = true;
+        sample_idle = idle;
+        sample_total = total;
+        sample_jiffies = jiffies;
+    }
+    percent = sample_percent;
+    spin_unlock(&cpu_sample_lock);
+
+    return percent;
+}
+
+/*
+ * cpu_usage_sample_x100
+ * Para quien puede dormir: si cpu_usage_recent_x100 no tiene una muestra reciente,
+ * espera 100ms (la llamada ya dejó la muestra inicial) y mide contra ella. Sigue
+ * pudiendo retornar CPU_USAGE_UNKNOWN si el intervalo no sirvió.
+ */
+u32 cpu_usage_sample_x100(void)
+{
+    u32 percent = cpu_usage_recent_x100();
+
+    if (percent == CPU_USAGE_UNKNOWN) {
+        msleep(100);
+        percent = cpu_usage_recent_x100();
+    }
+    return percent;
+}
+
 /*
  * SYSCALL_DEFINE1: Macro para definir la llamada al sistema.
  * - Nombre: cpu_usage
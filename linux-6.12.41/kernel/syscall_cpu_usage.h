@@ -0,0 +1,18 @@
+// kernel/syscall_cpu_usage.h
+// Muestreo de uso de CPU compartido con otras syscalls (syscall_cpu_usage.c).
+#ifndef _KERNEL_SYSCALL_CPU_USAGE_H
+#define _KERNEL_SYSCALL_CPU_USAGE_H
+
+#include <linux/types.h>
+#include <linux/limits.h>
+
+// Todavía no hay una muestra que sirva (recién arrancó, o la anterior es muy vieja)
+#define CPU_USAGE_UNKNOWN U32_MAX
+
+// Uso de CPU reciente (0 a 10000) sin dormir: compara contra la muestra anterior.
+// Puede retornar CPU_USAGE_UNKNOWN.
+u32 cpu_usage_recent_x100(void);
+// Igual, pero si no hay una muestra reciente duerme 100ms para tomarla
+u32 cpu_usage_sample_x100(void);
+
+#endif /* _KERNEL_SYSCALL_CPU_USAGE_H */
@@ -0,0 +1,802 @@
+// kernel/syscall_crypt.c
+// Utilidades compartidas por my_encrypt y my_decrypt: modos de cifrado,
+// cabecera de archivo, reparto en tramos por nodo NUMA e hilos fijados a ese nodo.
+#include <linux/kernel.h>
+#include <linux/fs.h>
+#include <linux/slab.h>
+#include <linux/mm.h>
+#include <linux/kthread.h>
+#include <linux/nodemask.h>
+#include <linux/topology.h>
+#include <linux/cpumask.h>
+#include <linux/string.h>
+#include <linux/unaligned.h>
+#include <linux/spinlock.h>
+#include <linux/cred.h>
+#include <linux/capability.h>
+#include <linux/namei.h>
+#include <linux/uio.h>
+#include <linux/pagemap.h>
+#include <linux/fadvise.h>
+#include <crypto/chacha.h>
+#include <crypto/sha2.h>
+#include "syscall_crypt.h"
+#include "syscall_cpu_usage.h"
+
+// Trabajos en curso. Cada crypt_job vive en la pila de la syscall que lo creó y
+// se saca de la lista antes de que esa syscall retorne.
+static LIST_HEAD(crypt_jobs);
+static DEFINE_SPINLOCK(crypt_jobs_lock);
+
+// Bloques que se cifran por llamada a chacha_crypt (múltiplo de CHACHA_BLOCK_SIZE,
+// porque solo la última llamada puede terminar en un bloque parcial).
+#define CRYPT_CHACHA_STEP (1U << 20)
+
+// ChaCha20 solo se compila si las librerías están dentro del kernel (=y): si no, las
+// llamadas a chacha_crypt/sha256 no enlazan y el modo responde -EOPNOTSUPP.
+#define CRYPT_HAVE_CHACHA (IS_REACHABLE(CONFIG_CRYPTO_LIB_CHACHA) && IS_REACHABLE(CONFIG_CRYPTO_LIB_SHA256))
+
+/*
+ * crypt_cipher_init
+ * Prepara la clave según el modo:
+ * - XOR: se usa tal cual, repitiéndose a lo largo del archivo.
+ * - ChaCha20: la clave de 256 bits es el SHA-256 del archivo de clave y el
+ *   nonce (aleatorio por archivo) viaja en la cabecera.
+ */
+int crypt_cipher_init(struct crypt_cipher *cipher, int mode, const unsigned char *key,
+                      size_t key_length, const u8 *nonce)
+{
+#if CRYPT_HAVE_CHACHA
+    u8 digest[SHA256_DIGEST_SIZE];
+    int i;
+#endif
+
+    memset(cipher, 0, sizeof(*cipher));
+    cipher->mode = mode;
+    cipher->key = key;
+    cipher->key_length = key_length;
+
+    switch (mode) {
+    case CRYPT_MODE_XOR:
+        return 0;
+    case CRYPT_MODE_CHACHA20:
+#if CRYPT_HAVE_CHACHA
+        sha256(key, key_length, digest);
+        for (i = 0; i < ARRAY_SIZE(cipher->chacha_key); i++)
+            cipher->chacha_key[i] = get_unaligned_le32(digest + i * sizeof(u32));
+        memcpy(cipher->nonce, nonce, CRYPT_NONCE_SIZE);
+        memzero_explicit(digest, sizeof(digest));
+        return 0;
+#else
+        return -EOPNOTSUPP;
+#endif
+    default:
+        return -EINVAL;
+    }
+}
+
+// XOR con la clave repetida; 'pos' dice qué byte de la clave toca primero.
+static void crypt_xor_keystream(const struct crypt_cipher *cipher, unsigned char *data, size_t len, u64 pos)
+{
+    size_t i, k = pos % cipher->key_length;
+
+    for (i = 0; i < len; i++) {
+        data[i] ^= cipher->key[k];
+        // Evitamos el módulo por byte: la clave vuelve a empezar al llegar al final
+        if (++k == cipher->key_length)
+            k = 0;
+    }
+}
+
+#if CRYPT_HAVE_CHACHA
+/*
+ * ChaCha20 en modo contador: el keystream del byte 'pos' sale del bloque
+ * pos / 64, así que cada hilo arranca directamente en su fragmento sin
+ * depender de los anteriores (y se puede descifrar cualquier rango suelto).
+ * El contador es de 32 bits: quien llama garantiza pos + len <= CRYPT_CHACHA_MAX_BYTES
+ * (si no, el keystream se repetiría con el mismo nonce).
+ */
+static void crypt_chacha_keystream(const struct crypt_cipher *cipher, unsigned char *data, size_t len, u64 pos)
+{
+    u32 state[CHACHA_STATE_WORDS];
+    u8 iv[CHACHA_IV_SIZE];
+    u8 block[CHACHA_BLOCK_SIZE];
+    size_t skip = pos % CHACHA_BLOCK_SIZE, n, i;
+    unsigned int step;
+
+    // IV de ChaCha20 en Linux: contador de bloque de 32 bits (LE) + nonce de 96 bits
+    put_unaligned_le32((u32)(pos / CHACHA_BLOCK_SIZE), iv);
+    memcpy(iv + sizeof(u32), cipher->nonce, CRYPT_NONCE_SIZE);
+    chacha_init(state, cipher->chacha_key, iv);
+
+    // Si el fragmento empieza a mitad de un bloque, usamos solo la cola de ese bloque
+    if (skip) {
+        memset(block, 0, sizeof(block));
+        chacha_crypt(state, block, block, CHACHA_BLOCK_SIZE, 20);
+        n = min_t(size_t, len, CHACHA_BLOCK_SIZE - skip);
+        for (i = 0; i < n; i++)
+            data[i] ^= block[skip + i];
+        data += n;
+        len -= n;
+        memzero_explicit(block, sizeof(block));
+    }
+
+    while (len) {
+        step = min_t(size_t, len, CRYPT_CHACHA_STEP);
+        chacha_crypt(state, data, data, step, 20);
+        data += step;
+        len -= step;
+    }
+    memzero_explicit(state, sizeof(state));
+}
+#endif
+
+// Aplica el keystream del modo elegido a 'len' bytes que empiezan en la posición 'pos' de los datos.
+void crypt_apply_keystream(const struct crypt_cipher *cipher, unsigned char *data, size_t len, u64 pos)
+{
+#if CRYPT_HAVE_CHACHA
+    if (cipher->mode == CRYPT_MODE_CHACHA20) {
+        crypt_chacha_keystream(cipher, data, len, pos);
+        return;
+    }
+#endif
+    // Sin ChaCha20 crypt_cipher_init no deja crear otro modo que XOR
+    crypt_xor_keystream(cipher, data, len, pos);
+}
+
+// Arma la cabecera (con el nonce) que va al inicio de los datos cifrados.
+void crypt_header_init(struct crypt_file_header *header, const struct crypt_cipher *cipher, u64 data_size, u32 flags)
+{
+    memset(header, 0, sizeof(*header));
+    memcpy(header->magic, CRYPT_HEADER_MAGIC, sizeof(header->magic));
+    header->version = cpu_to_le16(CRYPT_HEADER_VERSION);
+    header->mode = cpu_to_le16(cipher->mode);
+    memcpy(header->nonce, cipher->nonce, CRYPT_NONCE_SIZE);
+    header->data_size = cpu_to_le64(data_size);
+    header->flags = cpu_to_le32(flags);
+}
+
+// Valida una cabecera de datos cifrados con 'mode' y las banderas CRYPT_HEADER_* 'flags'.
+// Devuelve el nonce y el tamaño de los datos.
+int crypt_header_parse(const struct crypt_file_header *header, int mode, u32 flags, u8 *nonce, u64 *data_size)
+{
+    if (memcmp(header->magic, CRYPT_HEADER_MAGIC, sizeof(header->magic)))
+        return -EBADMSG; // No es un archivo cifrado por my_encrypt
+    if (le16_to_cpu(header->version) != CRYPT_HEADER_VERSION || le16_to_cpu(header->mode) != mode)
+        return -EINVAL; // Cifrado con otro modo/versión
+    if (le32_to_cpu(header->flags) != flags)
+        return -EINVAL; // Comprimido y se pidió sin comprimir, o al revés
+    if (mode == CRYPT_MODE_CHACHA20 && le64_to_cpu(header->data_size) > CRYPT_CHACHA_MAX_BYTES)
+        return -EBADMSG;
+
+    memcpy(nonce, header->nonce, CRYPT_NONCE_SIZE);
+    *data_size = le64_to_cpu(header->data_size);
+    return 0;
+}
+
+// Escribe la cabecera al inicio del archivo cifrado. Si 'crc' no es NULL le suma
+// los bytes de la cabecera (ver crypt_stream.header_crc).
+int crypt_header_write(struct file *output_file, const struct crypt_cipher *cipher, u64 data_size, u32 flags,
+                       loff_t *out_offset, u32 *crc)
+{
+    struct crypt_file_header header;
+    ssize_t ret;
+
+    crypt_header_init(&header, cipher, data_size, flags);
+    ret = kernel_write(output_file, &header, sizeof(header), out_offset);
+    if (ret < 0)
+        return ret;
+    if (ret != sizeof(header))
+        return -EIO;
+    if (crc)
+        *crc = crypt_crc_update(*crc, &header, sizeof(header));
+    return 0;
+}
+
+// Lee y valida la cabecera de un archivo cifrado con 'mode'. Si 'crc' no es NULL le
+// suma los bytes leídos, tal como estaban en el archivo.
+int crypt_header_read(struct file *input_file, int mode, u32 flags, u8 *nonce, u64 *data_size, loff_t *in_offset,
+                      u32 *crc)
+{
+    struct crypt_file_header header;
+    ssize_t ret;
+
+    ret = kernel_read(input_file, &header, sizeof(header), in_offset);
+    if (ret < 0)
+        return ret;
+    if (ret != sizeof(header))
+        return -EBADMSG;
+    if (crc)
+        *crc = crypt_crc_update(*crc, &header, sizeof(header));
+    return crypt_header_parse(&header, mode, flags, nonce, data_size);
+}
+
+/*
+ * crypt_header_reject_lz4
+ * El modo XOR sin CRYPT_FLAG_LZ4 no lleva cabecera, así que crypt_header_read no
+ * llega a ver que el archivo se comprimió. Si empieza con la cabecera de un archivo
+ * XOR comprimido se rechaza con -EINVAL, como cuando la cabecera no coincide.
+ * (Que datos cifrados sin cabecera empiecen justo así es despreciable: 12 bytes fijos.)
+ */
+int crypt_header_reject_lz4(struct file *input_file)
+{
+    struct crypt_file_header header;
+    loff_t pos = 0;
+    ssize_t ret;
+
+    ret = kernel_read(input_file, &header, sizeof(header), &pos);
+    if (ret < 0)
+        return ret;
+    if (ret == sizeof(header) && !memcmp(header.magic, CRYPT_HEADER_MAGIC, sizeof(header.magic)) &&
+        le16_to_cpu(header.version) == CRYPT_HEADER_VERSION && le16_to_cpu(header.mode) == CRYPT_MODE_XOR &&
+        le32_to_cpu(header.flags) == CRYPT_HEADER_LZ4)
+        return -EINVAL;
+    return 0;
+}
+
+// Registra el trabajo del hilo actual para que crypt_job_ctl lo pueda ver.
+void crypt_job_begin(struct crypt_job *job, u64 bytes_total)
+{
+    job->owner = current;
+    job->owner_euid = current_euid();
+    job->bytes_total = bytes_total;
+    atomic64_set(&job->bytes_done, 0);
+    job->phase = CRYPT_JOB_PHASE_READING;
+    job->cancelled = false;
+
+    spin_lock(&crypt_jobs_lock);
+    list_add_tail(&job->node, &crypt_jobs);
+    spin_unlock(&crypt_jobs_lock);
+}
+
+// Saca el trabajo de la lista. Se puede llamar aunque nunca se haya registrado.
+void crypt_job_end(struct crypt_job *job)
+{
+    spin_lock(&crypt_jobs_lock);
+    list_del_init(&job->node);
+    spin_unlock(&crypt_jobs_lock);
+}
+
+void crypt_job_cancel(struct crypt_job *job)
+{
+    if (job)
+        WRITE_ONCE(job->cancelled, true);
+}
+
+// Busca el trabajo del hilo 'pid' (visto desde el namespace del que pregunta). Con crypt_jobs_lock tomado.
+static struct crypt_job *crypt_job_find(pid_t pid)
+{
+    struct crypt_job *job;
+
+    list_for_each_entry(job, &crypt_jobs, node) {
+        if (task_pid_vnr(job->owner) == pid)
+            return job;
+    }
+    return NULL;
+}
+
+static void crypt_job_copy_status(const struct crypt_job *job, struct crypt_job_status *status)
+{
+    status->bytes_total = job->bytes_total;
+    status->bytes_done = atomic64_read(&job->bytes_done);
+    status->phase = READ_ONCE(job->phase);
+    status->cancelled = READ_ONCE(job->cancelled);
+}
+
+// Copia el estado del trabajo de 'pid'. -ESRCH si ese hilo no tiene un trabajo en curso.
+// Mismas reglas que cancelar: el avance y el tamaño dicen qué archivo procesa otro usuario.
+int crypt_job_query(pid_t pid, struct crypt_job_status *status)
+{
+    struct crypt_job *job;
+    bool need_cap = false;
+    int ret = -ESRCH;
+
+    spin_lock(&crypt_jobs_lock);
+    job = crypt_job_find(pid);
+    if (job) {
+        if (uid_eq(current_euid(), job->owner_euid)) {
+            crypt_job_copy_status(job, status);
+            ret = 0;
+        } else {
+            need_cap = true;
+        }
+    }
+    spin_unlock(&crypt_jobs_lock);
+    if (!need_cap)
+        return ret;
+
+    // Igual que en crypt_job_request_cancel: capable() va sin el spinlock
+    if (!capable(CAP_KILL))
+        return -EPERM;
+    ret = -ESRCH;
+    spin_lock(&crypt_jobs_lock);
+    job = crypt_job_find(pid);
+    if (job) {
+        crypt_job_copy_status(job, status);
+        ret = 0;
+    }
+    spin_unlock(&crypt_jobs_lock);
+    return ret;
+}
+
+// Pide cancelar el trabajo de 'pid'. Mismas reglas que kill(): mismo usuario o CAP_KILL.
+int crypt_job_request_cancel(pid_t pid)
+{
+    struct crypt_job *job;
+    bool need_cap = false;
+    int ret = -ESRCH;
+
+    spin_lock(&crypt_jobs_lock);
+    job = crypt_job_find(pid);
+    if (job) {
+        if (uid_eq(current_euid(), job->owner_euid)) {
+            crypt_job_cancel(job);
+            ret = 0;
+        } else {
+            need_cap = true;
+        }
+    }
+    spin_unlock(&crypt_jobs_lock);
+    if (!need_cap)
+        return ret;
+
+    // capable() puede auditar (y dormir): se llama sin el spinlock y después se busca
+    // el trabajo de nuevo, porque pudo haber terminado mientras tanto.
+    if (!capable(CAP_KILL))
+        return -EPERM;
+    ret = -ESRCH;
+    spin_lock(&crypt_jobs_lock);
+    job = crypt_job_find(pid);
+    if (job) {
+        crypt_job_cancel(job);
+        ret = 0;
+    }
+    spin_unlock(&crypt_jobs_lock);
+    return ret;
+}
+
+/*
+ * crypt_open_output
+ * Abre la salida como O_CREAT | O_TRUNC, pero avisa en 'created' si el archivo lo
+ * creó esta llamada: solo ese se puede borrar si el trabajo se cancela.
+ */
+struct file *crypt_open_output(const char *output_filepath, bool *created)
+{
+    struct file *file;
+
+    file = filp_open(output_filepath, O_WRONLY | O_CREAT | O_EXCL, 0644);
+    *created = !IS_ERR(file);
+    if (PTR_ERR_OR_ZERO(file) == -EEXIST)
+        file = filp_open(output_filepath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    return file;
+}
+
+/*
+ * crypt_remove_output
+ * Borra el archivo de salida de un trabajo cancelado, para no dejar un
+ * archivo a medio cifrar. Si alguien lo renombró o borró mientras tanto no se toca.
+ * Un archivo que ya existía antes de la llamada ('created' falso) no se borra:
+ * solo se deja vacío, como lo había dejado O_TRUNC.
+ */
+void crypt_remove_output(struct file *output_file, bool created)
+{
+    struct dentry *dentry = output_file->f_path.dentry;
+    struct dentry *parent;
+    struct inode *dir;
+    int ret = 0;
+
+    if (!created) {
+        ret = vfs_truncate(&output_file->f_path, 0);
+        if (ret)
+            printk(KERN_ERR "No se pudo vaciar la salida parcial: %d\n", ret);
+        return;
+    }
+
+    parent = dget_parent(dentry);
+    dir = d_inode(parent);
+
+    inode_lock_nested(dir, I_MUTEX_PARENT);
+    if (dentry->d_parent == parent && d_is_positive(dentry))
+        ret = vfs_unlink(file_mnt_idmap(output_file), dir, dentry, NULL);
+    inode_unlock(dir);
+    dput(parent);
+
+    if (ret)
+        printk(KERN_ERR "No se pudo borrar la salida parcial: %d\n", ret);
+}
+
+/*
+ * crypt_resolve_threads
+ * Decide cuántos hilos usar para 'data_size' bytes.
+ * - CRYPT_THREADS_AUTO: un hilo por cada CRYPT_MIN_BYTES_PER_THREAD, sin pasar
+ *   de las CPUs en línea que hoy están libres según el muestreo de cpu_usage
+ *   (si no hay una muestra del último segundo duerme 100ms para tomarla).
+ * - Un número explícito se respeta, salvo que haya más hilos que páginas de datos
+ *   (hilos vacíos o de pocos bytes). El pipeline además usa solo los que entran en
+ *   su anillo (ver crypt_pipeline_groups).
+ * Retorna al menos 1, o -EINVAL si thread_count es negativo o pasa de CRYPT_THREADS_MAX.
+ */
+int crypt_resolve_threads(int thread_count, size_t data_size)
+{
+    unsigned int cpus, load, idle_cpus;
+    size_t by_size;
+
+    if (thread_count < 0 || thread_count > CRYPT_THREADS_MAX)
+        return -EINVAL;
+
+    if (thread_count != CRYPT_THREADS_AUTO) {
+        by_size = max_t(size_t, DIV_ROUND_UP(data_size, PAGE_SIZE), 1);
+        return min_t(size_t, thread_count, by_size);
+    }
+
+    by_size = max_t(size_t, data_size / CRYPT_MIN_BYTES_PER_THREAD, 1);
+    if (by_size == 1)
+        return 1; // Archivo pequeño: ni siquiera vale la pena muestrear la carga
+
+    // CPUs libres = CPUs en línea * (1 - uso), redondeando hacia arriba
+    cpus = num_online_cpus();
+    // Sin una muestra no se sabe la carga: se asume la mitad, ni todas las CPUs libres
+    // (el primer cifrado después de arrancar usaría todas) ni un solo hilo
+    load = cpu_usage_sample_x100();
+    load = load == CPU_USAGE_UNKNOWN ? 5000 : min_t(u32, load, 10000);
+    idle_cpus = max_t(unsigned int, DIV_ROUND_UP(cpus * (10000 - load), 10000), 1);
+
+    return min_t(size_t, min_t(size_t, by_size, idle_cpus), CRYPT_THREADS_MAX);
+}
+
+/*
+ * crypt_segments_alloc
+ * Divide el archivo en tramos y reserva la memoria de cada uno.
+ * - Archivos pequeños (o máquinas de un solo nodo): un único tramo en el
+ *   nodo donde corre el proceso que llamó a la syscall.
+ * - Archivos grandes en máquinas NUMA: un tramo por cada nodo con CPUs, de
+ *   forma que el XOR de cada tramo nunca cruce de socket.
+ * Retorna la cantidad de tramos o un error negativo.
+ */
+int crypt_segments_alloc(struct crypt_segment **segments_out, size_t file_size, int thread_count)
+{
+    struct crypt_segment *segments;
+    int segment_count = 1, node, s;
+    size_t per_segment;
+    loff_t offset = 0;
+
+    if (thread_count < 1)
+        return -EINVAL;
+
+    if (file_size >= CRYPT_NUMA_SPLIT_MIN && num_node_state(N_CPU) > 1)
+        segment_count = min_t(int, num_node_state(N_CPU), thread_count);
+
+    segments = crypt_pool_zalloc(segment_count * sizeof(*segments), NUMA_NO_NODE);
+    if (!segments)
+        return -ENOMEM;
+
+    // Por defecto todo queda en el nodo local; si hay varios tramos cada uno
+    // toma un nodo con CPUs distinto.
+    for (s = 0; s < segment_count; s++)
+        segments[s].node = numa_node_id();
+    if (segment_count > 1) {
+        s = 0;
+        for_each_node_state(node, N_CPU) {
+            if (s == segment_count)
+                break;
+            segments[s++].node = node;
+        }
+    }
+
+    per_segment = file_size / segment_count;
+    for (s = 0; s < segment_count; s++) {
+        segments[s].file_offset = offset;
+        // El último tramo se lleva los bytes que sobran de la división
+        segments[s].length = (s == segment_count - 1) ? file_size - offset : per_segment;
+        // Los hilos se reparten entre tramos; todos reciben al menos uno
+        segments[s].thread_count = thread_count / segment_count + (s < thread_count % segment_count);
+
+        // Las páginas quedan en el nodo pedido (un pedazo del pool si cabe en uno)
+        segments[s].buffer = crypt_pool_alloc(segments[s].length, segments[s].node);
+        if (!segments[s].buffer) {
+            crypt_segments_free(segments, segment_count);
+            return -ENOMEM;
+        }
+        offset += segments[s].length;
+    }
+
+    *segments_out = segments;
+    return segment_count;
+}
+
+// Lee el archivo de entrada, tramo por tramo, a la memoria de cada nodo.
+int crypt_segments_read(struct file *input_file, struct crypt_segment *segments, int segment_count, loff_t *in_offset)
+{
+    ssize_t ret;
+    int s;
+
+    for (s = 0; s < segment_count; s++) {
+        ret = crypt_file_read(input_file, segments[s].buffer, segments[s].length, in_offset, false);
+        if (ret < 0)
+            return ret;
+    }
+    return 0;
+}
+
+// Escribe los tramos en orden. Retorna el total de bytes escritos.
+ssize_t crypt_segments_write(struct file *output_file, struct crypt_segment *segments, int segment_count, loff_t *out_offset)
+{
+    ssize_t ret, total = 0;
+    int s;
+
+    for (s = 0; s < segment_count; s++) {
+        ret = crypt_file_write(output_file, segments[s].buffer, segments[s].length, out_offset, false);
+        if (ret < 0)
+            return ret;
+        total += ret;
+    }
+    return total;
+}
+
+void crypt_segments_free(struct crypt_segment *segments, int segment_count)
+{
+    int s;
+
+    if (!segments)
+        return;
+    for (s = 0; s < segment_count; s++)
+        crypt_pool_free(segments[s].buffer, segments[s].length);
+    crypt_pool_free(segments, segment_count * sizeof(*segments));
+}
+
+// ¿Se puede hacer esta operación con I/O directo? El sistema de archivos tiene que
+// soportarlo y posición, largo y buffer tienen que estar alineados.
+static bool crypt_can_direct(struct file *file, const void *buf, size_t len, loff_t pos)
+{
+    return (file->f_mode & FMODE_CAN_ODIRECT) &&
+           IS_ALIGNED((unsigned long)pos | len | (unsigned long)buf, CRYPT_DIRECT_ALIGN);
+}
+
+// Una sola lectura/escritura con IOCB_DIRECT: los datos no pasan por el page cache.
+static ssize_t crypt_direct_rw(struct file *file, void *buf, size_t len, loff_t *pos, unsigned int dir)
+{
+    struct kvec kv = { .iov_base = buf, .iov_len = len };
+    struct iov_iter iter;
+    struct kiocb kiocb;
+    ssize_t ret;
+
+    init_sync_kiocb(&kiocb, file);
+    kiocb.ki_pos = *pos;
+    kiocb.ki_flags |= IOCB_DIRECT;
+    iov_iter_kvec(&iter, dir, &kv, 1, len);
+
+    if (dir == ITER_SOURCE)
+        ret = vfs_iocb_iter_write(file, &kiocb, &iter);
+    else
+        ret = vfs_iocb_iter_read(file, &kiocb, &iter);
+    if (ret > 0)
+        *pos = kiocb.ki_pos;
+    return ret;
+}
+
+/*
+ * crypt_file_read / crypt_file_write
+ * Leen/escriben 'len' bytes completos (repiten si la operación queda corta).
+ * Con 'direct' usan I/O directo mientras la alineación lo permita; lo que no se
+ * puede (el final del archivo, un sistema de archivos sin O_DIRECT) va por el
+ * camino normal. Leer 0 bytes antes de tiempo es -EIO: el archivo se achicó.
+ */
+ssize_t crypt_file_read(struct file *file, void *buf, size_t len, loff_t *pos, bool direct)
+{
+    size_t done = 0;
+    ssize_t ret;
+
+    while (done < len) {
+        ret = -EINVAL;
+        if (direct && crypt_can_direct(file, buf + done, len - done, *pos))
+            ret = crypt_direct_rw(file, buf + done, len - done, pos, ITER_DEST);
+        if (ret == -EINVAL) // Sin I/O directo (o el dispositivo pide otra alineación)
+            ret = kernel_read(file, buf + done, len - done, pos);
+        if (ret < 0)
+            return ret;
+        if (ret == 0)
+            return -EIO;
+        done += ret;
+    }
+    return done;
+}
+
+ssize_t crypt_file_write(struct file *file, const void *buf, size_t len, loff_t *pos, bool direct)
+{
+    size_t done = 0;
+    ssize_t ret;
+
+    while (done < len) {
+        ret = -EINVAL;
+        if (direct && crypt_can_direct(file, buf + done, len - done, *pos))
+            ret = crypt_direct_rw(file, (void *)buf + done, len - done, pos, ITER_SOURCE);
+        if (ret == -EINVAL)
+            ret = kernel_write(file, buf + done, len - done, pos);
+        if (ret < 0)
+            return ret;
+        if (ret == 0)
+            return -EIO;
+        done += ret;
+    }
+    return done;
+}
+
+/*
+ * crypt_drop_cache
+ * Saca del page cache el rango [start, start + len) de 'file'. Las páginas sucias
+ * se escriben primero (y se espera a que terminen), porque DONTNEED solo descarta
+ * páginas limpias.
+ */
+void crypt_drop_cache(struct file *file, loff_t start, u64 len)
+{
+    if (!len)
+        return;
+    filemap_write_and_wait_range(file->f_mapping, start, start + len - 1);
+    vfs_fadvise(file, start, len, POSIX_FADV_DONTNEED);
+}
+
+/*
+ * crypt_range_cached
+ * ¿Hay alguna página de [start, start + len) de 'file' en el page cache? Se mira
+ * antes de leer: si el rango ya estaba (lo usa otro proceso) no se descarta después,
+ * para no sacarle del cache a otro servicio lo que estaba usando.
+ */
+bool crypt_range_cached(struct file *file, loff_t start, u64 len)
+{
+    return len && filemap_range_has_page(file->f_mapping, start, start + len - 1);
+}
+
+// Ejecuta 'threadfn' sobre todo el tramo en el hilo actual.
+static int crypt_run_inline(int (*threadfn)(void *), struct crypt_segment *segment,
+                            const struct crypt_cipher *cipher, struct crypt_job *job, u32 *checksum)
+{
+    struct task_params params = {
+        .data_fragment = {
+            .buffer = segment->buffer,
+            .data_size = segment->length,
+            .cipher = cipher,
+            .start_idx = 0,
+            .end_idx = segment->length,
+            .file_offset = segment->file_offset,
+            .job = job,
+            .checksum = checksum != NULL,
+        },
+    };
+
+    init_completion(&params.completed_event);
+    threadfn(&params);
+
+    if (crypt_job_cancelled(job))
+        return crypt_job_cancel_error();
+    if (checksum)
+        *checksum = params.data_fragment.crc;
+    return 0;
+}
+
+/*
+ * crypt_run_fragments
+ * Reparte cada tramo entre sus hilos, los lanza (fijados al nodo del tramo)
+ * y espera a que todos terminen. 'threadfn' recibe un struct task_params.
+ * Una señal fatal mientras se espera cancela el trabajo: los hilos dejan de
+ * procesar en su siguiente bloque y se retorna -EINTR.
+ * Si 'checksum' no es NULL, cada hilo calcula el CRC32C de su pedazo y acá se
+ * encadenan en el orden de los datos. Queda el CRC de los datos con semilla 0 y sin
+ * invertir: el que llama lo encadena detrás de lo que vaya antes en el archivo.
+ */
+int crypt_run_fragments(int (*threadfn)(void *), const char *namefmt, struct crypt_segment *segments,
+                        int segment_count, const struct crypt_cipher *cipher, int thread_count,
+                        struct crypt_job *job, u32 *checksum)
+{
+    // Arrays para gestionar los múltiples hilos
+    struct task_params *task_list;
+    struct task_struct **thread_list;
+    DataFragment *fragment_list;
+
+    size_t fragment_size, extra_bytes;
+    int i, j, s, launched, ret_val = 0;
+
+    // Un solo hilo: se trabaja directo en el hilo que llamó, sin crear kthreads
+    if (thread_count == 1 && segment_count == 1)
+        return crypt_run_inline(threadfn, &segments[0], cipher, job, checksum);
+
+    // Asignamos memoria para las listas de control de hilos (del pool, sin tocar el allocator)
+    thread_list = crypt_pool_alloc(thread_count * sizeof(struct task_struct *), NUMA_NO_NODE);
+    task_list = crypt_pool_alloc(thread_count * sizeof(struct task_params), NUMA_NO_NODE);
+    fragment_list = crypt_pool_alloc(thread_count * sizeof(DataFragment), NUMA_NO_NODE);
+
+    if (!thread_list || !task_list || !fragment_list) {
+        ret_val = -ENOMEM;
+        goto free_all_resources;
+    }
+
+    // Bucle para crear y lanzar cada hilo; 'i' numera los hilos globalmente
+    // y 'j' dentro del tramo que le toca.
+    i = 0;
+    for (s = 0; s < segment_count; s++) {
+        // Calculamos cuánto trabajo le toca a cada hilo de este tramo
+        fragment_size = segments[s].length / segments[s].thread_count;
+        extra_bytes = segments[s].length % segments[s].thread_count; // Lo que sobra si la división no es exacta
+
+        for (j = 0; j < segments[s].thread_count; j++, i++) {
+            // Configuramos los datos que este hilo específico va a usar
+            fragment_list[i].buffer = segments[s].buffer; // Los hilos del tramo comparten su buffer
+            fragment_list[i].data_size = segments[s].length;
+            fragment_list[i].cipher = cipher;
+            fragment_list[i].file_offset = segments[s].file_offset;
+            fragment_list[i].job = job;
+            fragment_list[i].checksum = checksum != NULL;
+            fragment_list[i].crc = 0;
+
+            // Calculamos dónde empieza y termina este hilo
+            fragment_list[i].start_idx = (size_t)j * fragment_size;
+            // El último hilo del tramo se lleva los bytes extra que sobraron
+            fragment_list[i].end_idx = (j == segments[s].thread_count - 1)
+                                     ? (size_t)(j + 1) * fragment_size + extra_bytes
+                                     : (size_t)(j + 1) * fragment_size;
+
+            task_list[i].data_fragment = fragment_list[i];
+            init_completion(&task_list[i].completed_event); // Inicializamos el semáforo/aviso
+
+            // Igual que kthread_run, pero el hilo queda fijado a las CPUs del nodo del tramo
+            thread_list[i] = crypt_start_worker(threadfn, &task_list[i], segments[s].node, namefmt, i);
+            if (IS_ERR(thread_list[i])) {
+                ret_val = PTR_ERR(thread_list[i]);
+                goto wait_threads;
+            }
+        }
+    }
+
+    // El hilo principal se detiene aquí hasta que todos los trabajadores terminen.
+    // Si falló la creación de un hilo igual esperamos a los ya lanzados antes de liberar memoria.
+wait_threads:
+    launched = i;
+    for (i = 0; i < launched; i++) {
+        // wait_for_completion_killable vuelve antes si llega una señal fatal (kill -9).
+        // En ese caso marcamos el trabajo como cancelado y esperamos igual a que el
+        // hilo lo note: todos usan los buffers que se liberan al salir.
+        if (wait_for_completion_killable(&task_list[i].completed_event)) {
+            crypt_job_cancel(job);
+            wait_for_completion(&task_list[i].completed_event);
+        }
+    }
+    if (ret_val == 0 && crypt_job_cancelled(job))
+        ret_val = crypt_job_cancel_error();
+
+    // Los hilos están numerados en el orden de los datos
+    if (ret_val == 0 && checksum) {
+        u32 crc = 0;
+
+        for (i = 0; i < launched; i++)
+            crc = crypt_crc_combine(crc, task_list[i].data_fragment.crc,
+                                    task_list[i].data_fragment.end_idx - task_list[i].data_fragment.start_idx);
+        *checksum = crc;
+    }
+
+free_all_resources:
+    crypt_pool_free(thread_list, thread_count * sizeof(struct task_struct *));
+    crypt_pool_free(task_list, thread_count * sizeof(struct task_params));
+    crypt_pool_free(fragment_list, thread_count * sizeof(DataFragment));
+    return ret_val;
+}
+
+/*
+ * crypt_start_worker
+ * Igual que kthread_run, pero la estructura del hilo se reserva en 'node' y el
+ * hilo solo puede correr en las CPUs de ese nodo (las más cercanas a los datos).
+ */
+struct task_struct *crypt_start_worker(int (*threadfn)(void *), void *data, int node,
+                                       const char *namefmt, int idx)
+{
+    struct task_struct *task;
+
+    task = kthread_create_on_node(threadfn, data, node, namefmt, idx);
+    if (IS_ERR(task))
+        return task;
+
+    // Si el nodo se quedó sin CPUs en línea dejamos que el scheduler decida
+    if (node != NUMA_NO_NODE && cpumask_intersects(cpumask_of_node(node), cpu_online_mask))
+        set_cpus_allowed_ptr(task, cpumask_of_node(node));
+
+    wake_up_process(task);
+    return task;
+}
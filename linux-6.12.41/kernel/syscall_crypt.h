@@ -0,0 +1,320 @@
+// kernel/syscall_crypt.h
+// Definiciones compartidas por my_encrypt (syscall_encrypt.c) y my_decrypt (syscall_decrypt.c).
+#ifndef _KERNEL_SYSCALL_CRYPT_H
+#define _KERNEL_SYSCALL_CRYPT_H
+
+#include <linux/types.h>
+#include <linux/completion.h>
+#include <linux/sched.h>
+#include <linux/sched/signal.h>
+#include <linux/build_bug.h>
+#include <linux/list.h>
+#include <linux/uidgid.h>
+#include <linux/atomic.h>
+#include <linux/string.h>
+#include <linux/crc32.h>
+#include <crypto/chacha.h>
+
+struct file;
+
+// Modos de cifrado aceptados por my_encrypt / my_decrypt (argumento 'mode').
+#define CRYPT_MODE_XOR      0 // XOR con la clave repetida (formato original, sin cabecera)
+#define CRYPT_MODE_CHACHA20 1 // ChaCha20 en modo contador, con cabecera y nonce aleatorio
+#define CRYPT_MODE_MASK     0xff
+
+// Banderas que se combinan con el modo en el mismo argumento (my_encrypt / my_decrypt):
+// no ensuciar el page cache con los datos del trabajo, para no desalojar lo que usan
+// otros servicios de la máquina.
+#define CRYPT_FLAG_DIRECT       0x100 // Salida con I/O directo (o descartando las páginas escritas)
+#define CRYPT_FLAG_DIRECT_INPUT 0x200 // Lo mismo para la entrada (lo que ya estaba en cache se deja)
+#define CRYPT_FLAG_LZ4          0x400 // Comprimir con LZ4 antes de cifrar (y descomprimir al descifrar)
+#define CRYPT_FLAG_VERIFY       0x800 // my_decrypt: comparar contra el checksum que pasa el usuario
+#define CRYPT_FLAGS_MASK        (CRYPT_FLAG_DIRECT | CRYPT_FLAG_DIRECT_INPUT | CRYPT_FLAG_LZ4 | \
+                                 CRYPT_FLAG_VERIFY)
+// Alineación de posición, largo y buffer que se exige para usar I/O directo
+#define CRYPT_DIRECT_ALIGN      PAGE_SIZE
+
+// El contador de bloque de ChaCha20 es de 32 bits: 2^32 bloques de 64 bytes.
+#define CRYPT_CHACHA_MAX_BYTES ((u64)U32_MAX * CHACHA_BLOCK_SIZE)
+#define CRYPT_NONCE_SIZE 12
+
+// Cabecera al inicio de los archivos cifrados con un modo distinto de XOR.
+#define CRYPT_HEADER_MAGIC   "SO2C"
+#define CRYPT_HEADER_VERSION 1
+struct crypt_file_header {
+    u8 magic[4];                  // CRYPT_HEADER_MAGIC
+    __le16 version;               // CRYPT_HEADER_VERSION
+    __le16 mode;                  // CRYPT_MODE_* usado al cifrar
+    u8 nonce[CRYPT_NONCE_SIZE];   // Nonce aleatorio del archivo
+    __le64 data_size;             // Bytes de datos originales (sin comprimir)
+    __le32 flags;                 // CRYPT_HEADER_* (0 en archivos sin comprimir)
+} __packed;
+static_assert(sizeof(struct crypt_file_header) == 32);
+
+// Archivo comprimido con LZ4 (CRYPT_FLAG_LZ4). Después de la cabecera va un índice
+// con un __le32 por bloque de CRYPT_LZ4_BLOCK bytes originales: lo que ocupa el
+// bloque en el archivo. Un bloque que no se pudo achicar se guarda tal cual
+// (ocupa exactamente CRYPT_LZ4_BLOCK, o lo que quede en el último).
+#define CRYPT_HEADER_LZ4 0x1
+#define CRYPT_LZ4_BLOCK  (256U << 10) // 256 KiB
+
+// Cifrado listo para usar: la clave en el formato que necesita cada modo.
+struct crypt_cipher {
+    int mode;                                // CRYPT_MODE_*
+    const unsigned char *key;                // Clave cruda (modo XOR)
+    size_t key_length;
+    u32 chacha_key[CHACHA_KEY_SIZE / sizeof(u32)]; // SHA-256 de la clave (modo ChaCha20)
+    u8 nonce[CRYPT_NONCE_SIZE];
+};
+
+// Argumentos de my_crypt_buffer. Se pasan por puntero (no caben en los 6 registros
+// de una syscall); 'size' permite agregar campos al final sin romper a los usuarios viejos.
+struct crypt_buffer_args {
+    __u64 input;                  // Puntero de usuario a los datos de entrada
+    __u64 input_length;
+    __u64 output;                 // Puntero de usuario donde se deja el resultado
+    __u64 output_length;          // Capacidad de 'output'
+    __u64 key;                    // Puntero de usuario a la clave (mismo contenido que el archivo de clave)
+    __u64 key_length;
+    __s32 thread_count;           // CRYPT_THREADS_AUTO (0) para que elija el kernel
+    __s32 mode;                   // CRYPT_MODE_*
+    __u32 flags;                  // CRYPT_BUFFER_*
+    __u32 reserved;
+};
+#define CRYPT_BUFFER_ARGS_SIZE_VER0 64
+static_assert(sizeof(struct crypt_buffer_args) == CRYPT_BUFFER_ARGS_SIZE_VER0);
+#define CRYPT_BUFFER_DECRYPT 0x1        // Descifrar en vez de cifrar
+#define CRYPT_BUFFER_MAX     (1ULL << 30) // Máximo de datos por llamada (páginas fijadas)
+#define CRYPT_BUFFER_KEY_MAX (1ULL << 20)
+
+// Trabajo en curso de my_encrypt/my_decrypt/my_crypt_buffer. Se identifica por el TID
+// del hilo que llamó a la syscall y se consulta/cancela con crypt_job_ctl.
+#define CRYPT_JOB_QUERY  0
+#define CRYPT_JOB_CANCEL 1
+
+#define CRYPT_JOB_PHASE_READING    0 // Leyendo la entrada
+#define CRYPT_JOB_PHASE_PROCESSING 1 // Hilos aplicando el keystream
+#define CRYPT_JOB_PHASE_WRITING    2 // Escribiendo la salida
+
+// Cada cuántos bytes un hilo publica su avance y revisa si lo cancelaron
+#define CRYPT_PROGRESS_STEP (1UL << 20) // 1 MiB
+
+struct crypt_job {
+    struct list_head node;        // Enlace en la lista global de trabajos
+    struct task_struct *owner;    // Hilo que llamó a la syscall (bloqueado hasta terminar)
+    kuid_t owner_euid;            // EUID del dueño al registrar el trabajo (para cancelarlo)
+    u64 bytes_total;
+    atomic64_t bytes_done;        // Bytes ya procesados por los hilos
+    int phase;                    // CRYPT_JOB_PHASE_*
+    bool cancelled;               // Pedido de cancelación (crypt_job_ctl o señal fatal)
+};
+
+// Lo que crypt_job_ctl(CRYPT_JOB_QUERY) copia al usuario
+struct crypt_job_status {
+    __u64 bytes_total;
+    __u64 bytes_done;
+    __u32 phase;
+    __u32 cancelled;
+};
+
+void crypt_job_begin(struct crypt_job *job, u64 bytes_total);
+void crypt_job_end(struct crypt_job *job);
+void crypt_job_cancel(struct crypt_job *job);
+int crypt_job_query(pid_t pid, struct crypt_job_status *status);
+int crypt_job_request_cancel(pid_t pid);
+
+static inline void crypt_job_init(struct crypt_job *job)
+{
+    INIT_LIST_HEAD(&job->node);
+}
+
+static inline void crypt_job_set_phase(struct crypt_job *job, int phase)
+{
+    if (job)
+        WRITE_ONCE(job->phase, phase);
+}
+
+static inline void crypt_job_add_progress(struct crypt_job *job, size_t bytes)
+{
+    if (job)
+        atomic64_add(bytes, &job->bytes_done);
+}
+
+// También cuenta como cancelado un kill -9 al dueño mientras procesa en su propio hilo
+static inline bool crypt_job_cancelled(struct crypt_job *job)
+{
+    return job && (READ_ONCE(job->cancelled) ||
+                   (current == job->owner && fatal_signal_pending(current)));
+}
+
+// Código de error de un trabajo cancelado: -EINTR si fue por una señal fatal
+static inline int crypt_job_cancel_error(void)
+{
+    return fatal_signal_pending(current) ? -EINTR : -ECANCELED;
+}
+
+// thread_count == 0 pide que el kernel elija la cantidad de hilos (crypt_resolve_threads).
+#define CRYPT_THREADS_AUTO 0
+#define CRYPT_THREADS_MAX  256 // Más que esto se rechaza con -EINVAL
+// Mínimo de datos por hilo en modo automático: con menos, crear el kthread
+// cuesta más que lo que ahorra. Con un solo hilo se trabaja en el hilo que llamó.
+#define CRYPT_MIN_BYTES_PER_THREAD (2UL << 20) // 2 MiB
+
+// A partir de este tamaño el archivo se reparte en un buffer por nodo NUMA
+// (solo en máquinas con más de un nodo con CPUs).
+#define CRYPT_NUMA_SPLIT_MIN (8UL << 20) // 8 MiB
+
+// Estructura que define "un pedazo" de trabajo para un hilo.
+// Contiene punteros a los datos, la clave y dónde empezar/terminar.
+typedef struct {
+    unsigned char *buffer;        // Buffer (local al nodo) que contiene este pedazo
+    size_t data_size;             // Tamaño del buffer
+    const struct crypt_cipher *cipher; // Cifrado (modo y clave) a aplicar
+    size_t start_idx;             // Byte (dentro de buffer) donde este hilo empieza a trabajar
+    size_t end_idx;               // Byte (dentro de buffer) donde este hilo termina
+    loff_t file_offset;           // Posición de buffer[0] dentro de los datos, para alinear el keystream
+    struct crypt_job *job;        // Trabajo al que se reporta el avance (puede ser NULL)
+    bool checksum;                // Calcular el CRC32C del pedazo mientras se procesa
+    u32 crc;                      // CRC32C (semilla 0) de los datos cifrados del pedazo
+} DataFragment;
+
+// Estructura para coordinar el hilo.
+struct task_params {
+    DataFragment data_fragment;   // Los datos que el hilo va a procesar
+    struct completion completed_event; // Una "señal" para avisar cuando termine
+};
+
+// Un tramo contiguo del archivo guardado en memoria del nodo 'node'.
+// Los hilos que procesan el tramo se fijan a las CPUs de ese mismo nodo.
+struct crypt_segment {
+    unsigned char *buffer;        // Datos del tramo (reservados en 'node')
+    size_t length;                // Bytes del tramo
+    loff_t file_offset;           // Dónde empieza el tramo dentro de los datos (sin cabecera)
+    int node;                     // Nodo NUMA dueño de la memoria
+    int thread_count;             // Hilos asignados a este tramo
+};
+
+// Archivo a archivo por el pipeline de syscall_crypt_pipeline.c: los datos se
+// procesan en pedazos de CRYPT_PIPELINE_CHUNK con CRYPT_PIPELINE_DEPTH buffers
+// en vuelo (uno leyéndose, uno cifrándose y uno escribiéndose).
+#define CRYPT_PIPELINE_CHUNK (4UL << 20) // 4 MiB
+#define CRYPT_PIPELINE_DEPTH 3
+// Tope de pedazos del anillo de una llamada (96 MiB): limita cuántos grupos de hilos
+// cifran a la vez (con LZ4 cada buffer lleva otro pedazo de salida, así que la mitad).
+// Es también lo que el pool guarda por nodo para que el anillo se reuse entero.
+#define CRYPT_PIPELINE_RING_CHUNKS 24
+
+// Origen y destino de un cifrado de archivo a archivo
+struct crypt_stream {
+    struct file *input;
+    loff_t in_offset;             // Dónde empiezan los datos en 'input' (después de la cabecera)
+    struct file *output;
+    loff_t out_offset;            // Dónde se escriben los datos en 'output'
+    u64 data_size;                // Bytes de datos a procesar (sin comprimir)
+    unsigned int flags;           // CRYPT_FLAG_*
+    bool decrypt;                 // Con CRYPT_FLAG_LZ4: descifrar y descomprimir (si no, al revés)
+    u32 *checksum;                // Si no es NULL: CRC32C del archivo cifrado
+    u32 header_crc;               // CRC de la cabecera desde CRYPT_CRC_SEED (sin cabecera: la semilla)
+};
+
+// Checksum de integridad: CRC32C del archivo cifrado entero, tal como queda en disco:
+// la cabecera, el índice LZ4 y los datos. Así un nonce o un índice alterados también
+// hacen fallar CRYPT_FLAG_VERIFY. Los datos se cuentan al cifrar sobre lo que sale de
+// los hilos y al descifrar sobre lo que entra, en la misma pasada que el keystream,
+// así los dos lados dan el mismo valor sin volver a leer el archivo.
+// Cada hilo calcula el CRC de su pedazo con semilla 0 y después se encadenan en orden
+// detrás de la cabecera y el índice.
+#define CRYPT_CRC_SEED (~0U)
+
+static inline u32 crypt_crc_update(u32 crc, const void *data, size_t len)
+{
+    return IS_REACHABLE(CONFIG_CRC32) ? __crc32c_le(crc, data, len) : 0;
+}
+
+// CRC de A||B a partir del CRC de A y el de B (semilla 0, 'len' bytes)
+static inline u32 crypt_crc_combine(u32 crc, u32 next, size_t len)
+{
+    return IS_REACHABLE(CONFIG_CRC32) ? __crc32c_le_combine(crc, next, len) : 0;
+}
+
+static inline u32 crypt_crc_final(u32 crc)
+{
+    return ~crc;
+}
+
+int crypt_cipher_init(struct crypt_cipher *cipher, int mode, const unsigned char *key,
+                      size_t key_length, const u8 *nonce);
+void crypt_apply_keystream(const struct crypt_cipher *cipher, unsigned char *data, size_t len, u64 pos);
+
+static inline bool crypt_mode_has_header(int mode)
+{
+    return mode != CRYPT_MODE_XOR;
+}
+void crypt_header_init(struct crypt_file_header *header, const struct crypt_cipher *cipher, u64 data_size, u32 flags);
+int crypt_header_parse(const struct crypt_file_header *header, int mode, u32 flags, u8 *nonce, u64 *data_size);
+int crypt_header_write(struct file *output_file, const struct crypt_cipher *cipher, u64 data_size, u32 flags,
+                       loff_t *out_offset, u32 *crc);
+int crypt_header_read(struct file *input_file, int mode, u32 flags, u8 *nonce, u64 *data_size, loff_t *in_offset,
+                      u32 *crc);
+int crypt_header_reject_lz4(struct file *input_file);
+
+int crypt_resolve_threads(int thread_count, size_t data_size);
+int crypt_segments_alloc(struct crypt_segment **segments_out, size_t file_size, int thread_count);
+int crypt_segments_read(struct file *input_file, struct crypt_segment *segments, int segment_count, loff_t *in_offset);
+ssize_t crypt_segments_write(struct file *output_file, struct crypt_segment *segments, int segment_count, loff_t *out_offset);
+void crypt_segments_free(struct crypt_segment *segments, int segment_count);
+
+ssize_t crypt_file_read(struct file *file, void *buf, size_t len, loff_t *pos, bool direct);
+ssize_t crypt_file_write(struct file *file, const void *buf, size_t len, loff_t *pos, bool direct);
+void crypt_drop_cache(struct file *file, loff_t start, u64 len);
+bool crypt_range_cached(struct file *file, loff_t start, u64 len);
+
+struct task_struct *crypt_start_worker(int (*threadfn)(void *), void *data, int node,
+                                       const char *namefmt, int idx);
+int crypt_run_fragments(int (*threadfn)(void *), const char *namefmt, struct crypt_segment *segments,
+                        int segment_count, const struct crypt_cipher *cipher, int thread_count,
+                        struct crypt_job *job, u32 *checksum);
+struct file *crypt_open_output(const char *output_filepath, bool *created);
+void crypt_remove_output(struct file *output_file, bool created);
+ssize_t crypt_pipeline_run(const struct crypt_stream *stream, int (*threadfn)(void *), const char *namefmt,
+                           const struct crypt_cipher *cipher, int thread_count, struct crypt_job *job);
+
+// Pool de buffers reutilizables (syscall_crypt_pool.c): en régimen estable las
+// syscalls de cifrado no reservan memoria, reusan la de llamadas anteriores.
+// Hasta CRYPT_POOL_SMALL va a kmalloc (el slab ya lo cachea). Hasta una página, hasta
+// CRYPT_POOL_BLOCK (memoria de LZ4, arreglos de muchos hilos) y de medio pedazo a
+// CRYPT_PIPELINE_CHUNK (buffers de datos) sale del pool; el resto, de kvmalloc_node.
+#define CRYPT_POOL_SMALL 512
+#define CRYPT_POOL_BLOCK (32UL << 10) // 32 KiB: los arreglos de CRYPT_THREADS_MAX hilos
+
+void *crypt_pool_alloc(size_t size, int node);
+void crypt_pool_free(void *ptr, size_t size);
+struct seq_file;
+void crypt_pool_show(struct seq_file *m);
+
+// Como kcalloc: los buffers del pool vuelven con lo que tenían
+static inline void *crypt_pool_zalloc(size_t size, int node)
+{
+    void *ptr = crypt_pool_alloc(size, node);
+
+    if (ptr)
+        memset(ptr, 0, size);
+    return ptr;
+}
+
+// Contadores por CPU de cada syscall (debugfs: so2_crypt/stats) y tracepoints
+// (events/so2_crypt), ver syscall_crypt_stats.c y syscall_crypt_trace.h.
+#define CRYPT_STAT_ENCRYPT       0
+#define CRYPT_STAT_DECRYPT       1
+#define CRYPT_STAT_DECRYPT_RANGE 2
+#define CRYPT_STAT_BUFFER        3
+#define CRYPT_STAT_COUNT         4
+
+u64 crypt_stats_begin(int op);
+void crypt_stats_end(int op, u64 start_ns, long ret);
+
+// Trabajadores de cada syscall (reciben un struct task_params)
+int perform_xor_operation(void *arg);
+int perform_xor_decryption(void *arg);
+
+#endif /* _KERNEL_SYSCALL_CRYPT_H */
@@ -0,0 +1,243 @@
+// kernel/my_crypt_buffer.c
+// Cifra/descifra directamente entre buffers de usuario, sin rutas de archivo.
+// El resultado tiene el mismo formato que my_encrypt (cabecera incluida en ChaCha20),
+// así que un buffer cifrado aquí se puede guardar en disco y descifrar con my_decrypt.
+#include <linux/syscalls.h>
+#include <linux/uaccess.h>
+#include <linux/slab.h>
+#include <linux/mm.h>
+#include <linux/vmalloc.h>
+#include <linux/random.h>
+#include <linux/topology.h>
+#include "syscall_crypt.h"
+
+/*
+ * crypt_map_user_buffer
+ * Fija (pin) las páginas de usuario [uaddr, uaddr + len) y las mapea de forma
+ * contigua en el kernel: los kthreads no tienen el espacio de memoria del
+ * proceso, así que trabajan sobre este mapeo.
+ */
+static void *crypt_map_user_buffer(unsigned long uaddr, size_t len, struct page ***pages_out, int *nr_pages_out)
+{
+    unsigned long first_page = uaddr & PAGE_MASK;
+    int nr_pages = DIV_ROUND_UP(offset_in_page(uaddr) + len, PAGE_SIZE);
+    struct page **pages;
+    int pinned = 0, ret;
+    void *vaddr;
+
+    // Del pool, como los arreglos de control de crypt_run_fragments
+    pages = crypt_pool_alloc(nr_pages * sizeof(*pages), NUMA_NO_NODE);
+    if (!pages)
+        return ERR_PTR(-ENOMEM);
+
+    // pin_user_pages_fast puede fijar menos páginas de las pedidas: repetimos
+    while (pinned < nr_pages) {
+        ret = pin_user_pages_fast(first_page + (unsigned long)pinned * PAGE_SIZE,
+                                  nr_pages - pinned, FOLL_WRITE, pages + pinned);
+        if (ret <= 0) {
+            ret = ret ? ret : -EFAULT;
+            goto unpin;
+        }
+        pinned += ret;
+    }
+
+    vaddr = vmap(pages, nr_pages, VM_MAP, PAGE_KERNEL);
+    if (!vaddr) {
+        ret = -ENOMEM;
+        goto unpin;
+    }
+
+    *pages_out = pages;
+    *nr_pages_out = nr_pages;
+    return vaddr + offset_in_page(uaddr);
+
+unpin:
+    unpin_user_pages(pages, pinned);
+    crypt_pool_free(pages, nr_pages * sizeof(*pages));
+    return ERR_PTR(ret);
+}
+
+static void crypt_unmap_user_buffer(void *kaddr, struct page **pages, int nr_pages)
+{
+    vunmap((void *)((unsigned long)kaddr & PAGE_MASK));
+    // Los hilos escribieron en las páginas: se marcan sucias al soltarlas
+    unpin_user_pages_dirty_lock(pages, nr_pages, true);
+    crypt_pool_free(pages, nr_pages * sizeof(*pages));
+}
+
+// Función principal: arma la cabecera, fija la salida y lanza los hilos sobre ella
+long handle_buffer_crypt(const struct crypt_buffer_args *args)
+{
+    bool decrypt = args->flags & CRYPT_BUFFER_DECRYPT;
+    size_t header_length = crypt_mode_has_header(args->mode) ? sizeof(struct crypt_file_header) : 0;
+    const u8 __user *input = u64_to_user_ptr(args->input);
+    u8 __user *output = u64_to_user_ptr(args->output);
+    const u8 __user *data_in;
+    u8 __user *data_out;
+    struct crypt_file_header header;
+    struct crypt_cipher cipher;
+    struct crypt_segment segment;
+    unsigned char *encryption_key, *kaddr;
+    u8 nonce[CRYPT_NONCE_SIZE] = { 0 };
+    struct page **pages;
+    int nr_pages;
+    size_t data_length, output_needed;
+    u64 data_size;
+    struct crypt_job job;
+    long ret_val;
+
+    // 1. LEER LA CLAVE (viene en memoria del usuario, no en un archivo)
+    encryption_key = crypt_pool_alloc(args->key_length, NUMA_NO_NODE);
+    if (!encryption_key)
+        return -ENOMEM;
+    if (copy_from_user(encryption_key, u64_to_user_ptr(args->key), args->key_length)) {
+        ret_val = -EFAULT;
+        goto free_encryption_key;
+    }
+
+    // 2. CABECERA Y TAMAÑOS
+    if (decrypt) {
+        if (args->input_length < header_length) {
+            ret_val = -EBADMSG;
+            goto free_encryption_key;
+        }
+        data_length = args->input_length - header_length;
+        if (header_length) {
+            if (copy_from_user(&header, input, sizeof(header))) {
+                ret_val = -EFAULT;
+                goto free_encryption_key;
+            }
+            ret_val = crypt_header_parse(&header, args->mode, 0, nonce, &data_size);
+            if (ret_val < 0) goto free_encryption_key;
+            if (data_size != data_length) {
+                ret_val = -EBADMSG;
+                goto free_encryption_key;
+            }
+        }
+        output_needed = data_length;
+    } else {
+        data_length = args->input_length;
+        // ChaCha20 usa un nonce aleatorio nuevo por buffer, igual que por archivo
+        get_random_bytes(nonce, sizeof(nonce));
+        output_needed = header_length + data_length;
+    }
+
+    if (data_length == 0) {
+        ret_val = -EINVAL;
+        goto free_encryption_key;
+    }
+    if (args->output_length < output_needed) {
+        ret_val = -ENOSPC;
+        goto free_encryption_key;
+    }
+    if (args->mode == CRYPT_MODE_CHACHA20 && data_length > CRYPT_CHACHA_MAX_BYTES) {
+        ret_val = -EFBIG;
+        goto free_encryption_key;
+    }
+
+    ret_val = crypt_cipher_init(&cipher, args->mode, encryption_key, args->key_length, nonce);
+    if (ret_val < 0) goto free_encryption_key;
+
+    data_in = input + (decrypt ? header_length : 0);
+    data_out = output + (decrypt ? 0 : header_length);
+
+    // Entrada y salida pueden ser el mismo buffer (in-place), pero no solaparse a medias
+    if (data_in != data_out &&
+        (unsigned long)data_in < (unsigned long)data_out + data_length &&
+        (unsigned long)data_out < (unsigned long)data_in + data_length) {
+        ret_val = -EINVAL;
+        goto free_cipher;
+    }
+
+    if (!decrypt && header_length) {
+        crypt_header_init(&header, &cipher, data_length, 0);
+        if (copy_to_user(output, &header, sizeof(header))) {
+            ret_val = -EFAULT;
+            goto free_cipher;
+        }
+    }
+
+    // 3. FIJAR Y MAPEAR EL BUFFER DE SALIDA
+    kaddr = crypt_map_user_buffer((unsigned long)data_out, data_length, &pages, &nr_pages);
+    if (IS_ERR(kaddr)) {
+        ret_val = PTR_ERR(kaddr);
+        goto free_cipher;
+    }
+
+    // 4. COPIAR LA ENTRADA A LA SALIDA (una sola copia; se cifra ahí mismo)
+    if (data_in != data_out && copy_from_user(kaddr, data_in, data_length)) {
+        ret_val = -EFAULT;
+        goto unmap_output;
+    }
+
+    // 5. LANZAR LOS HILOS sobre el mapeo del buffer de salida
+    segment.buffer = kaddr;
+    segment.length = data_length;
+    segment.file_offset = 0;
+    segment.node = numa_node_id();
+    segment.thread_count = crypt_resolve_threads(args->thread_count, data_length);
+    if (segment.thread_count < 0) {
+        ret_val = segment.thread_count; // Negativo o más de CRYPT_THREADS_MAX
+        goto unmap_output;
+    }
+    crypt_job_init(&job);
+    crypt_job_begin(&job, data_length);
+    crypt_job_set_phase(&job, CRYPT_JOB_PHASE_PROCESSING);
+    ret_val = crypt_run_fragments(decrypt ? perform_xor_decryption : perform_xor_operation,
+                                  decrypt ? "xor_decrypt_buf_%d" : "xor_buf_%d",
+                                  &segment, 1, &cipher, segment.thread_count, &job, NULL);
+    crypt_job_end(&job);
+    if (ret_val == 0)
+        ret_val = output_needed; // Bytes escritos en 'output'
+
+unmap_output:
+    crypt_unmap_user_buffer(kaddr, pages, nr_pages);
+
+free_cipher:
+    memzero_explicit(&cipher, sizeof(cipher));
+
+free_encryption_key:
+    // La clave no puede quedar en un buffer que después usa otra llamada
+    memzero_explicit(encryption_key, args->key_length);
+    crypt_pool_free(encryption_key, args->key_length);
+    return ret_val;
+}
+
+static long do_my_crypt_buffer(struct crypt_buffer_args __user *uargs, size_t usize) {
+    struct crypt_buffer_args args;
+    int ret;
+
+    // 1. COPIAR ARGUMENTOS (copy_struct_from_user acepta structs más nuevos/viejos)
+    if (usize < CRYPT_BUFFER_ARGS_SIZE_VER0)
+        return -EINVAL;
+    ret = copy_struct_from_user(&args, sizeof(args), uargs, usize);
+    if (ret)
+        return ret;
+
+    // 2. VALIDACIONES
+    if (args.mode & ~CRYPT_MODE_MASK || args.flags & ~CRYPT_BUFFER_DECRYPT || args.reserved)
+        return -EINVAL;
+    if (args.thread_count < 0 || !args.input || !args.output) // 0 = automático
+        return -EINVAL;
+    if (args.key_length == 0 || args.key_length > CRYPT_BUFFER_KEY_MAX)
+        return -EINVAL;
+    if (args.input_length > CRYPT_BUFFER_MAX + sizeof(struct crypt_file_header))
+        return -E2BIG;
+
+    return handle_buffer_crypt(&args);
+}
+
+/*
+ * SYSCALL_DEFINE2: my_crypt_buffer
+ * - args: puntero a struct crypt_buffer_args (entrada, salida, clave, hilos, modo)
+ * - size: sizeof(struct crypt_buffer_args) que conoce el usuario
+ * Retorna la cantidad de bytes escritos en la salida.
+ */
+SYSCALL_DEFINE2(my_crypt_buffer, struct crypt_buffer_args __user *, uargs, size_t, usize) {
+    u64 start_ns = crypt_stats_begin(CRYPT_STAT_BUFFER);
+    long ret_val;
+
+    ret_val = do_my_crypt_buffer(uargs, usize);
+    crypt_stats_end(CRYPT_STAT_BUFFER, start_ns, ret_val);
+    return ret_val;
+}
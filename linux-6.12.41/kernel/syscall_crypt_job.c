@@ -0,0 +1,40 @@
+// kernel/crypt_job_ctl.c
+// Consulta el avance de un my_encrypt/my_decrypt/my_crypt_buffer en curso, o lo cancela.
+// El trabajo se identifica por el TID del hilo que está bloqueado en la syscall.
+#include <linux/syscalls.h>
+#include <linux/uaccess.h>
+#include "syscall_crypt.h"
+
+/*
+ * SYSCALL_DEFINE3: crypt_job_ctl
+ * - pid: TID del hilo que llamó a my_encrypt/my_decrypt/my_crypt_buffer
+ * - op: CRYPT_JOB_QUERY (copia el estado a 'status') o CRYPT_JOB_CANCEL
+ * - status: struct crypt_job_status del usuario (solo para CRYPT_JOB_QUERY)
+ * Las dos operaciones siguen las reglas de kill(): el trabajo tiene que ser del mismo
+ * usuario (euid) o hace falta CAP_KILL; si no, -EPERM.
+ * Retorna -ESRCH si ese hilo no tiene un trabajo en curso. Un trabajo cancelado
+ * termina con -ECANCELED y su archivo de salida se borra.
+ */
+SYSCALL_DEFINE3(crypt_job_ctl, pid_t, pid, int, op, struct crypt_job_status __user *, status) {
+    struct crypt_job_status k_status = { 0 };
+    long ret_val;
+
+    if (pid <= 0)
+        return -EINVAL;
+
+    switch (op) {
+    case CRYPT_JOB_QUERY:
+        if (!status)
+            return -EINVAL;
+        ret_val = crypt_job_query(pid, &k_status);
+        if (ret_val < 0)
+            return ret_val;
+        if (copy_to_user(status, &k_status, sizeof(k_status)))
+            return -EFAULT;
+        return 0;
+    case CRYPT_JOB_CANCEL:
+        return crypt_job_request_cancel(pid);
+    default:
+        return -EINVAL;
+    }
+}
@@ -0,0 +1,793 @@
+// kernel/syscall_crypt_pipeline.c
+// Cifrado de archivo a archivo en tres etapas que se solapan: mientras se lee el
+// pedazo N+2, los hilos aplican el keystream al N+1 y un hilo escritor guarda el N.
+// Así el tiempo total se acerca a max(I/O, CPU) en vez de a la suma de ambos.
+// Con CRYPT_FLAG_DIRECT* los pedazos van con I/O directo y no ensucian el page cache.
+// Con CRYPT_FLAG_LZ4 los hilos además comprimen (o descomprimen) cada bloque de
+// CRYPT_LZ4_BLOCK bytes de forma independiente.
+// Si se pidió checksum, cada hilo calcula el CRC32C de su parte y el escritor
+// los encadena en el orden del archivo; al final se ponen detrás de la cabecera y
+// el índice.
+#include <linux/kernel.h>
+#include <linux/fs.h>
+#include <linux/slab.h>
+#include <linux/mm.h>
+#include <linux/kthread.h>
+#include <linux/nodemask.h>
+#include <linux/topology.h>
+#include <linux/wait.h>
+#include <linux/atomic.h>
+#include <linux/pagemap.h>
+#include <linux/lz4.h>
+#include "syscall_crypt.h"
+
+// Estados de un buffer del anillo
+#define CRYPT_SLOT_FREE  0 // Libre: el lector puede llenarlo
+#define CRYPT_SLOT_READY 1 // Leído: esperando a los hilos de cifrado
+#define CRYPT_SLOT_DONE  2 // Cifrado: esperando al escritor
+
+#define CRYPT_LZ4_BLOCKS_PER_CHUNK (CRYPT_PIPELINE_CHUNK / CRYPT_LZ4_BLOCK)
+static_assert(CRYPT_PIPELINE_CHUNK % CRYPT_LZ4_BLOCK == 0);
+static_assert(CRYPT_PIPELINE_RING_CHUNKS >= 2 * CRYPT_PIPELINE_DEPTH); // Al menos un grupo con LZ4
+
+struct crypt_pipeline;
+
+// Un buffer del anillo. 'seq' dice qué pedazo del archivo contiene.
+struct crypt_pipeline_slot {
+    unsigned char *buffer;        // CRYPT_PIPELINE_CHUNK bytes en el nodo del grupo
+    unsigned char *output;        // Solo LZ4: resultado de comprimir/descomprimir 'buffer'
+    size_t length;                // Bytes válidos (el primero y el último pueden ser más cortos)
+    u64 pos;                      // Posición del pedazo dentro de los datos
+    u64 seq;                      // Número de pedazo
+    int state;                    // CRYPT_SLOT_*
+    wait_queue_head_t wait;       // Quienes esperan un cambio de estado de este buffer
+    atomic_t pending;             // Hilos del grupo que todavía no terminaron su parte
+    u32 stored[CRYPT_LZ4_BLOCKS_PER_CHUNK]; // Solo LZ4: lo que ocupa cada bloque en el archivo
+
+    // Checksum: CRC de la parte de cada hilo (o de cada bloque con LZ4) y del pedazo entero
+    u32 *share_crc;
+    u32 block_crc[CRYPT_LZ4_BLOCKS_PER_CHUNK];
+    u32 crc;
+    size_t crc_length;            // Bytes cifrados que cubre 'crc'
+};
+
+// Un hilo del pipeline (cifrador o escritor)
+struct crypt_pipeline_worker {
+    struct crypt_pipeline *pipeline;
+    int group;                    // Grupo (nodo NUMA) al que pertenece
+    int index;                    // Posición dentro del grupo
+    void *lz4_mem;                // Memoria de trabajo de LZ4_compress_default
+    struct completion done;       // Avisa al hilo principal cuando sale
+};
+
+// Un grupo de hilos fijados a un nodo. Procesa los pedazos seq % group_count == grupo.
+// El tamaño del grupo depende del pedazo, no del archivo: cada hilo se lleva al menos
+// CRYPT_PIPELINE_MIN_SHARE de cada pedazo. Más hilos significan más grupos, es decir
+// más pedazos cifrándose a la vez, hasta los que entran en CRYPT_PIPELINE_RING_CHUNKS.
+#define CRYPT_PIPELINE_MIN_SHARE  (512UL << 10) // 512 KiB
+struct crypt_pipeline_group {
+    int node;
+    int thread_count;
+};
+
+struct crypt_pipeline {
+    const struct crypt_stream *stream;
+    const struct crypt_cipher *cipher;
+    int (*threadfn)(void *);
+    struct crypt_job *job;
+
+    struct crypt_pipeline_slot *slots;
+    int slot_count;               // CRYPT_PIPELINE_DEPTH por grupo
+    struct crypt_pipeline_group *groups;
+    int group_count;
+    u64 first_length;             // Largo del pedazo 0 (ver crypt_pipeline_layout)
+    u64 chunk_count;
+
+    // Solo LZ4: índice de bloques (ver CRYPT_HEADER_LZ4) y dónde empiezan los
+    // datos en el archivo comprimido, después del índice.
+    bool lz4;
+    __le32 *index;
+    u64 block_count;
+    loff_t in_data_offset;
+    loff_t out_data_offset;
+
+    bool checksum;                // stream->checksum != NULL
+    u32 crc;                      // CRC (semilla 0) de los pedazos ya escritos (solo lo toca el escritor)
+    u64 crc_length;               // Bytes que cubre 'crc'
+
+    int error;                    // Primer error; hace que todas las etapas terminen
+};
+
+// Un error despierta a todos (cada uno espera en la cola de algún buffer)
+static void crypt_pipeline_fail(struct crypt_pipeline *p, int error)
+{
+    int i;
+
+    cmpxchg(&p->error, 0, error);
+    for (i = 0; i < p->slot_count; i++)
+        wake_up_all(&p->slots[i].wait);
+}
+
+static bool crypt_pipeline_failed(struct crypt_pipeline *p)
+{
+    return READ_ONCE(p->error) != 0;
+}
+
+// ¿El buffer tiene el pedazo 'seq' en el estado 'state'? (o el pipeline falló)
+static bool crypt_slot_is(struct crypt_pipeline *p, struct crypt_pipeline_slot *slot, u64 seq, int state)
+{
+    return crypt_pipeline_failed(p) ||
+           (smp_load_acquire(&slot->state) == state && READ_ONCE(slot->seq) == seq);
+}
+
+// Solo despierta a los que esperan este buffer: el grupo que lo cifra, el lector o el escritor
+static void crypt_slot_set(struct crypt_pipeline *p, struct crypt_pipeline_slot *slot, int state)
+{
+    smp_store_release(&slot->state, state);
+    wake_up_all(&slot->wait);
+}
+
+// Aplica 'threadfn' (el keystream) a buffer[start, end). 'pos' es la posición de buffer[0] en los datos.
+// Retorna el CRC del rango (semilla 0) si se pidió checksum.
+static u32 crypt_pipeline_apply(struct crypt_pipeline *p, unsigned char *buffer, size_t start, size_t end, u64 pos)
+{
+    struct task_params params = {
+        .data_fragment = {
+            .buffer = buffer,
+            .data_size = end,
+            .cipher = p->cipher,
+            .start_idx = start,
+            .end_idx = end,
+            .file_offset = pos,
+            .job = p->job,
+            .checksum = p->checksum,
+        },
+    };
+
+    init_completion(&params.completed_event);
+    p->threadfn(&params);
+    return params.data_fragment.crc;
+}
+
+/*
+ * crypt_lz4_pack
+ * Comprime el bloque 'b' del pedazo a slot->output y lo cifra ahí mismo.
+ * El keystream del bloque arranca en su posición original (pos + b * CRYPT_LZ4_BLOCK):
+ * como un bloque nunca ocupa más que su tamaño original, los rangos de keystream
+ * de dos bloques no se pisan, y cada bloque se cifra sin esperar a los anteriores.
+ */
+static int crypt_lz4_pack(struct crypt_pipeline *p, struct crypt_pipeline_worker *worker,
+                          struct crypt_pipeline_slot *slot, int b)
+{
+    size_t start = (size_t)b * CRYPT_LZ4_BLOCK;
+    size_t raw = min_t(size_t, CRYPT_LZ4_BLOCK, slot->length - start);
+    int stored = 0;
+
+    // Capacidad raw - 1: si no se logra achicar, LZ4 falla y se guarda tal cual
+    if (IS_REACHABLE(CONFIG_LZ4_COMPRESS))
+        stored = LZ4_compress_default(slot->buffer + start, slot->output + start, raw, raw - 1,
+                                      worker->lz4_mem);
+    if (stored <= 0) {
+        memcpy(slot->output + start, slot->buffer + start, raw);
+        stored = raw;
+    }
+    slot->stored[b] = stored;
+
+    slot->block_crc[b] = crypt_pipeline_apply(p, slot->output, start, start + stored, slot->pos);
+    crypt_job_add_progress(p->job, raw - stored); // El keystream solo cuenta lo comprimido
+    return 0;
+}
+
+// Lo inverso: descifra el bloque 'b' en slot->buffer y lo descomprime a slot->output.
+static int crypt_lz4_unpack(struct crypt_pipeline *p, struct crypt_pipeline_slot *slot, int b)
+{
+    size_t start = (size_t)b * CRYPT_LZ4_BLOCK;
+    size_t raw = min_t(size_t, CRYPT_LZ4_BLOCK, slot->length - start);
+    u32 stored = slot->stored[b];
+    int ret = -1;
+
+    slot->block_crc[b] = crypt_pipeline_apply(p, slot->buffer, start, start + stored, slot->pos);
+    if (stored == raw) {
+        memcpy(slot->output + start, slot->buffer + start, raw); // Guardado sin comprimir
+    } else {
+        if (IS_REACHABLE(CONFIG_LZ4_DECOMPRESS))
+            ret = LZ4_decompress_safe(slot->buffer + start, slot->output + start, stored, raw);
+        if (ret != (int)raw)
+            return -EBADMSG; // Bloque corrupto (o la clave no es la correcta)
+    }
+    crypt_job_add_progress(p->job, raw - stored);
+    return 0;
+}
+
+// Encadena los CRC de las partes del pedazo (lo hace el último hilo del grupo en terminar)
+static void crypt_slot_checksum(struct crypt_pipeline *p, struct crypt_pipeline_slot *slot, int threads)
+{
+    size_t share, length;
+    int b, w;
+
+    slot->crc = 0;
+    slot->crc_length = 0;
+    if (p->lz4) {
+        for (b = 0; b < DIV_ROUND_UP(slot->length, CRYPT_LZ4_BLOCK); b++) {
+            slot->crc = crypt_crc_combine(slot->crc, slot->block_crc[b], slot->stored[b]);
+            slot->crc_length += slot->stored[b];
+        }
+        return;
+    }
+    share = slot->length / threads;
+    for (w = 0; w < threads; w++) {
+        length = (w == threads - 1) ? slot->length - (size_t)w * share : share;
+        slot->crc = crypt_crc_combine(slot->crc, slot->share_crc[w], length);
+    }
+    slot->crc_length = slot->length;
+}
+
+/*
+ * crypt_pipeline_xor
+ * Etapa 2: cada hilo del grupo aplica el keystream a su parte de cada pedazo
+ * del grupo. El último en terminar pasa el buffer al escritor.
+ */
+static int crypt_pipeline_xor(void *arg)
+{
+    struct crypt_pipeline_worker *worker = arg;
+    struct crypt_pipeline *p = worker->pipeline;
+    int threads = p->groups[worker->group].thread_count;
+    struct crypt_pipeline_slot *slot;
+    int b, blocks, ret;
+    size_t share;
+    u32 crc;
+    u64 seq;
+
+    for (seq = worker->group; seq < p->chunk_count; seq += p->group_count) {
+        slot = &p->slots[seq % p->slot_count];
+        wait_event_idle(slot->wait, crypt_slot_is(p, slot, seq, CRYPT_SLOT_READY));
+        if (crypt_pipeline_failed(p))
+            break;
+
+        if (p->lz4) {
+            // Con LZ4 se reparten bloques enteros: cada uno se comprime por separado
+            blocks = DIV_ROUND_UP(slot->length, CRYPT_LZ4_BLOCK);
+            for (b = worker->index * blocks / threads; b < (worker->index + 1) * blocks / threads; b++) {
+                ret = p->stream->decrypt ? crypt_lz4_unpack(p, slot, b) : crypt_lz4_pack(p, worker, slot, b);
+                if (ret < 0) {
+                    crypt_pipeline_fail(p, ret);
+                    goto out;
+                }
+            }
+        } else {
+            // La parte de este hilo; el último se lleva el resto de la división
+            share = slot->length / threads;
+            crc = crypt_pipeline_apply(p, slot->buffer, (size_t)worker->index * share,
+                                       (worker->index == threads - 1) ? slot->length
+                                                                      : (size_t)(worker->index + 1) * share,
+                                       slot->pos);
+            if (p->checksum)
+                slot->share_crc[worker->index] = crc;
+        }
+
+        if (crypt_job_cancelled(p->job)) {
+            crypt_pipeline_fail(p, -ECANCELED);
+            break;
+        }
+        if (atomic_dec_and_test(&slot->pending)) {
+            if (p->checksum)
+                crypt_slot_checksum(p, slot, threads);
+            crypt_slot_set(p, slot, CRYPT_SLOT_DONE);
+        }
+    }
+
+out:
+    complete(&worker->done);
+    return 0;
+}
+
+// Escribe los bloques comprimidos del pedazo uno detrás del otro y anota sus tamaños en el índice.
+static ssize_t crypt_lz4_write_blocks(struct crypt_pipeline *p, struct crypt_pipeline_slot *slot,
+                                      loff_t *out_offset, bool direct)
+{
+    int b, blocks = DIV_ROUND_UP(slot->length, CRYPT_LZ4_BLOCK);
+    u64 first_block = slot->pos / CRYPT_LZ4_BLOCK;
+    ssize_t ret;
+
+    for (b = 0; b < blocks; b++) {
+        ret = crypt_file_write(p->stream->output, slot->output + (size_t)b * CRYPT_LZ4_BLOCK,
+                               slot->stored[b], out_offset, direct);
+        if (ret < 0)
+            return ret;
+        p->index[first_block + b] = cpu_to_le32(slot->stored[b]);
+    }
+    return 0;
+}
+
+// Lee los bloques comprimidos del pedazo (tamaños según el índice), cada uno al inicio de su lugar en el buffer.
+static ssize_t crypt_lz4_read_blocks(struct crypt_pipeline *p, struct crypt_pipeline_slot *slot, u64 pos,
+                                     size_t length, loff_t *in_offset, bool direct)
+{
+    int b, blocks = DIV_ROUND_UP(length, CRYPT_LZ4_BLOCK);
+    u64 first_block = pos / CRYPT_LZ4_BLOCK;
+    ssize_t ret;
+
+    for (b = 0; b < blocks; b++) {
+        slot->stored[b] = le32_to_cpu(p->index[first_block + b]);
+        ret = crypt_file_read(p->stream->input, slot->buffer + (size_t)b * CRYPT_LZ4_BLOCK,
+                              slot->stored[b], in_offset, direct);
+        if (ret < 0)
+            return ret;
+    }
+    return 0;
+}
+
+/*
+ * crypt_pipeline_write
+ * Etapa 3: escribe los pedazos en orden y devuelve cada buffer al lector.
+ */
+static int crypt_pipeline_write(void *arg)
+{
+    struct crypt_pipeline_worker *worker = arg;
+    struct crypt_pipeline *p = worker->pipeline;
+    struct crypt_pipeline_slot *slot;
+    struct file *output = p->stream->output;
+    bool direct = p->stream->flags & CRYPT_FLAG_DIRECT;
+    loff_t out_offset = p->out_data_offset, start;
+    loff_t prev_start = 0;
+    size_t prev_length = 0, written;
+    ssize_t ret;
+    u64 seq;
+
+    for (seq = 0; seq < p->chunk_count; seq++) {
+        slot = &p->slots[seq % p->slot_count];
+        wait_event_idle(slot->wait, crypt_slot_is(p, slot, seq, CRYPT_SLOT_DONE));
+        if (crypt_pipeline_failed(p))
+            break;
+
+        start = out_offset;
+        if (p->lz4 && !p->stream->decrypt)
+            ret = crypt_lz4_write_blocks(p, slot, &out_offset, direct);
+        else
+            ret = crypt_file_write(output, p->lz4 ? slot->output : slot->buffer, slot->length, &out_offset, direct);
+        if (ret < 0) {
+            crypt_pipeline_fail(p, ret);
+            break;
+        }
+        if (p->checksum) {
+            p->crc = crypt_crc_combine(p->crc, slot->crc, slot->crc_length);
+            p->crc_length += slot->crc_length;
+        }
+        // Todo lo que se necesita del pedazo se toma antes de devolver el buffer:
+        // desde que queda libre el lector lo puede volver a llenar.
+        written = out_offset - start;
+        crypt_slot_set(p, slot, CRYPT_SLOT_FREE);
+
+        // Lo que no pudo ir con I/O directo quedó en el page cache: se manda a disco
+        // ya, y se descarta el pedazo anterior (su escritura ya debería haber terminado).
+        if (direct) {
+            filemap_fdatawrite_range(output->f_mapping, start, start + written - 1);
+            crypt_drop_cache(output, prev_start, prev_length);
+            prev_start = start;
+            prev_length = written;
+        }
+    }
+    if (direct)
+        crypt_drop_cache(output, prev_start, prev_length);
+
+    complete(&worker->done);
+    return 0;
+}
+
+// Bytes que ocupan en el archivo los bloques comprimidos de [pos, pos + length)
+static u64 crypt_lz4_stored_length(struct crypt_pipeline *p, u64 pos, size_t length)
+{
+    u64 b, first_block = pos / CRYPT_LZ4_BLOCK, total = 0;
+
+    for (b = 0; b < DIV_ROUND_UP(length, CRYPT_LZ4_BLOCK); b++)
+        total += le32_to_cpu(p->index[first_block + b]);
+    return total;
+}
+
+/*
+ * crypt_pipeline_read
+ * Etapa 1 (en el hilo que llamó a la syscall): llena los buffers libres en orden.
+ * Una señal fatal o un pedido de cancelación detienen todo el pipeline.
+ */
+static void crypt_pipeline_read(struct crypt_pipeline *p)
+{
+    struct crypt_pipeline_slot *slot;
+    struct file *input = p->stream->input;
+    bool direct = p->stream->flags & CRYPT_FLAG_DIRECT_INPUT;
+    loff_t in_offset = p->in_data_offset, start;
+    size_t length;
+    ssize_t ret;
+    u64 seq, pos, stored;
+    bool cached = false;
+
+    for (seq = 0; seq < p->chunk_count; seq++) {
+        slot = &p->slots[seq % p->slot_count];
+        if (wait_event_killable(slot->wait, crypt_pipeline_failed(p) ||
+                                         smp_load_acquire(&slot->state) == CRYPT_SLOT_FREE)) {
+            crypt_job_cancel(p->job);
+            crypt_pipeline_fail(p, -EINTR);
+        }
+        if (crypt_pipeline_failed(p))
+            return;
+        if (crypt_job_cancelled(p->job)) {
+            crypt_pipeline_fail(p, -ECANCELED);
+            return;
+        }
+
+        pos = seq ? p->first_length + (seq - 1) * CRYPT_PIPELINE_CHUNK : 0;
+        length = min_t(u64, seq ? CRYPT_PIPELINE_CHUNK : p->first_length, p->stream->data_size - pos);
+        start = in_offset;
+        if (direct) {
+            stored = (p->lz4 && p->stream->decrypt) ? crypt_lz4_stored_length(p, pos, length) : length;
+            cached = crypt_range_cached(input, start, stored);
+        }
+        if (p->lz4 && p->stream->decrypt)
+            ret = crypt_lz4_read_blocks(p, slot, pos, length, &in_offset, direct);
+        else
+            ret = crypt_file_read(input, slot->buffer, length, &in_offset, direct);
+        if (ret < 0) {
+            crypt_pipeline_fail(p, ret);
+            return;
+        }
+        // Las páginas leídas sin I/O directo están limpias: se descartan enseguida,
+        // salvo que ya estuvieran en el cache antes (las está usando alguien más)
+        if (direct && !cached)
+            crypt_drop_cache(input, start, in_offset - start);
+
+        slot->length = length;
+        slot->pos = pos;
+        WRITE_ONCE(slot->seq, seq);
+        atomic_set(&slot->pending, p->groups[seq % p->group_count].thread_count);
+        crypt_slot_set(p, slot, CRYPT_SLOT_READY);
+    }
+}
+
+/*
+ * crypt_lz4_index_init
+ * Al comprimir reserva el índice (se llena a medida que se escriben los bloques y
+ * se guarda al final). Al descomprimir lo lee y lo valida: cada bloque ocupa entre
+ * 1 byte y su tamaño original, y entre todos cubren exactamente el resto del archivo.
+ */
+static int crypt_lz4_index_init(struct crypt_pipeline *p)
+{
+    const struct crypt_stream *stream = p->stream;
+    loff_t offset = stream->in_offset;
+    u64 b, raw, stored, total = 0, block_count;
+    size_t index_size;
+    ssize_t ret;
+
+    if (!IS_REACHABLE(CONFIG_LZ4_COMPRESS) || !IS_REACHABLE(CONFIG_LZ4_DECOMPRESS))
+        return -EOPNOTSUPP;
+
+    // Al descifrar, data_size viene de la cabecera (no confiable): antes de reservar
+    // nada se comprueba que el índice y al menos un byte por bloque quepan en el archivo
+    block_count = DIV_ROUND_UP_ULL(stream->data_size, CRYPT_LZ4_BLOCK);
+    if (stream->decrypt &&
+        block_count * (sizeof(*p->index) + 1) > (u64)(i_size_read(file_inode(stream->input)) - offset))
+        return -EBADMSG;
+
+    p->block_count = block_count;
+    p->index = crypt_pool_alloc(p->block_count * sizeof(*p->index), NUMA_NO_NODE);
+    if (!p->index)
+        return -ENOMEM;
+    index_size = p->block_count * sizeof(*p->index);
+
+    if (!stream->decrypt) {
+        p->out_data_offset = stream->out_offset + index_size;
+        return 0;
+    }
+
+    ret = crypt_file_read(stream->input, p->index, index_size, &offset, false);
+    if (ret < 0)
+        return ret;
+    for (b = 0; b < p->block_count; b++) {
+        raw = min_t(u64, CRYPT_LZ4_BLOCK, stream->data_size - b * CRYPT_LZ4_BLOCK);
+        stored = le32_to_cpu(p->index[b]);
+        if (stored == 0 || stored > raw)
+            return -EBADMSG;
+        total += stored;
+    }
+    if (offset + total != i_size_read(file_inode(stream->input)))
+        return -EBADMSG; // Archivo truncado o con basura al final
+
+    p->in_data_offset = offset;
+    return 0;
+}
+
+// Guarda el índice ya completo en el lugar que se le reservó después de la cabecera.
+static int crypt_lz4_index_write(struct crypt_pipeline *p)
+{
+    loff_t offset = p->stream->out_offset;
+    ssize_t ret;
+
+    ret = crypt_file_write(p->stream->output, p->index, p->block_count * sizeof(*p->index), &offset, false);
+    return ret < 0 ? ret : 0;
+}
+
+// Checksum final, en el orden del archivo: cabecera, índice LZ4 (tal como se
+// escribió o se leyó) y los datos que encadenó el escritor.
+static u32 crypt_pipeline_crc(struct crypt_pipeline *p)
+{
+    u32 crc = p->stream->header_crc;
+
+    if (p->lz4)
+        crc = crypt_crc_update(crc, p->index, p->block_count * sizeof(*p->index));
+    return crypt_crc_final(crypt_crc_combine(crc, p->crc, p->crc_length));
+}
+
+/*
+ * crypt_pipeline_layout
+ * Todos los pedazos miden CRYPT_PIPELINE_CHUNK salvo el primero, que se acorta
+ * para que los siguientes empiecen alineados en el archivo que va con I/O directo
+ * (la cabecera de ChaCha20 corre 32 bytes los datos de la salida al cifrar y los
+ * de la entrada al descifrar). Si se pidió I/O directo en ambos lados manda la salida.
+ */
+static void crypt_pipeline_layout(struct crypt_pipeline *p)
+{
+    const struct crypt_stream *stream = p->stream;
+    u64 misalign = 0;
+
+    // Con LZ4 los bloques tienen largos variables en el archivo: no hay nada que
+    // alinear, y los pedazos tienen que contener bloques enteros.
+    if (p->lz4)
+        misalign = 0;
+    else if (stream->flags & CRYPT_FLAG_DIRECT)
+        misalign = stream->out_offset % CRYPT_PIPELINE_CHUNK;
+    else if (stream->flags & CRYPT_FLAG_DIRECT_INPUT)
+        misalign = stream->in_offset % CRYPT_PIPELINE_CHUNK;
+
+    p->first_length = CRYPT_PIPELINE_CHUNK - misalign;
+    p->chunk_count = 1;
+    if (stream->data_size > p->first_length)
+        p->chunk_count += DIV_ROUND_UP_ULL(stream->data_size - p->first_length, CRYPT_PIPELINE_CHUNK);
+}
+
+/*
+ * crypt_pipeline_groups
+ * Reparte los hilos en grupos de a lo sumo CRYPT_PIPELINE_CHUNK / CRYPT_PIPELINE_MIN_SHARE.
+ * En archivos grandes de máquinas NUMA hay al menos un grupo por nodo con CPUs (igual
+ * que crypt_segments_alloc) y los grupos se asignan a los nodos por turno.
+ * Nunca hay más grupos que pedazos: un grupo sin pedazos solo ocuparía buffers.
+ * Los grupos tampoco pasan de lo que entra en CRYPT_PIPELINE_RING_CHUNKS (8, o 4
+ * con LZ4), así que el anillo no usa más de 96 MiB por llamada. Con eso quedan
+ * a lo sumo 64 hilos (32 con LZ4).
+ * Retorna cuántos hilos se usan: los que no entran en los grupos no se crean.
+ */
+static int crypt_pipeline_groups(struct crypt_pipeline *p, int thread_count)
+{
+    int per_group = CRYPT_PIPELINE_CHUNK / CRYPT_PIPELINE_MIN_SHARE;
+    int max_groups = CRYPT_PIPELINE_RING_CHUNKS / (CRYPT_PIPELINE_DEPTH * (p->lz4 ? 2 : 1));
+    int nodes = 1, group_count, node, g;
+
+    if (p->stream->data_size >= CRYPT_NUMA_SPLIT_MIN && num_node_state(N_CPU) > 1)
+        nodes = min_t(int, num_node_state(N_CPU), thread_count);
+    group_count = max_t(int, nodes, DIV_ROUND_UP(thread_count, per_group));
+    group_count = min_t(u64, min(group_count, max_groups), p->chunk_count);
+    nodes = min(nodes, group_count);
+    thread_count = min(thread_count, group_count * per_group);
+
+    p->groups = crypt_pool_zalloc(group_count * sizeof(*p->groups), NUMA_NO_NODE);
+    if (!p->groups)
+        return -ENOMEM;
+    p->group_count = group_count;
+
+    p->groups[0].node = numa_node_id();
+    if (nodes > 1) {
+        g = 0;
+        for_each_node_state(node, N_CPU) {
+            if (g == nodes)
+                break;
+            p->groups[g++].node = node;
+        }
+    }
+    for (g = nodes; g < group_count; g++)
+        p->groups[g].node = p->groups[g % nodes].node;
+    for (g = 0; g < group_count; g++)
+        p->groups[g].thread_count = thread_count / group_count + (g < thread_count % group_count);
+    return thread_count;
+}
+
+// Archivos de un solo pedazo: no hay nada que solapar, se procesan en memoria de una vez.
+static ssize_t crypt_pipeline_single(const struct crypt_stream *stream, int (*threadfn)(void *),
+                                     const char *namefmt, const struct crypt_cipher *cipher,
+                                     int thread_count, struct crypt_job *job)
+{
+    struct crypt_segment *segments = NULL;
+    loff_t in_offset = stream->in_offset, out_offset = stream->out_offset;
+    bool input_cached = false;
+    u32 data_crc = 0;
+    int segment_count;
+    ssize_t ret;
+
+    segment_count = crypt_segments_alloc(&segments, stream->data_size, thread_count);
+    if (segment_count < 0)
+        return segment_count;
+
+    if (stream->flags & CRYPT_FLAG_DIRECT_INPUT)
+        input_cached = crypt_range_cached(stream->input, stream->in_offset, stream->data_size);
+    ret = crypt_segments_read(stream->input, segments, segment_count, &in_offset);
+    if (ret < 0) goto free_segments;
+    // Un solo pedazo no justifica alinear buffers: con las banderas de I/O directo
+    // solo se descartan del page cache las páginas que trajo el trabajo (si la
+    // entrada ya estaba en el cache, la está usando alguien más y se deja).
+    if ((stream->flags & CRYPT_FLAG_DIRECT_INPUT) && !input_cached)
+        crypt_drop_cache(stream->input, stream->in_offset, stream->data_size);
+
+    crypt_job_set_phase(job, CRYPT_JOB_PHASE_PROCESSING);
+    ret = crypt_run_fragments(threadfn, namefmt, segments, segment_count, cipher, thread_count, job,
+                              stream->checksum ? &data_crc : NULL);
+    if (ret < 0) goto free_segments;
+
+    crypt_job_set_phase(job, CRYPT_JOB_PHASE_WRITING);
+    ret = crypt_segments_write(stream->output, segments, segment_count, &out_offset);
+    if (ret >= 0 && (stream->flags & CRYPT_FLAG_DIRECT))
+        crypt_drop_cache(stream->output, stream->out_offset, stream->data_size);
+    if (ret >= 0 && crypt_job_cancelled(job))
+        ret = crypt_job_cancel_error();
+    if (ret >= 0 && stream->checksum)
+        *stream->checksum = crypt_crc_final(crypt_crc_combine(stream->header_crc, data_crc, stream->data_size));
+
+free_segments:
+    crypt_segments_free(segments, segment_count);
+    return ret;
+}
+
+/*
+ * crypt_pipeline_run
+ * Copia stream->data_size bytes de 'input' a 'output' aplicando 'threadfn'
+ * (perform_xor_operation / perform_xor_decryption) en el camino.
+ * - El hilo que llamó lee, 'thread_count' kthreads cifran y un kthread escribe.
+ * - El anillo tiene CRYPT_PIPELINE_DEPTH buffers de CRYPT_PIPELINE_CHUNK por
+ *   grupo, a lo sumo CRYPT_PIPELINE_RING_CHUNKS pedazos en total (96 MiB): la
+ *   memoria usada no depende del tamaño del archivo ni de cuántos hilos se pidan.
+ * - Usa a lo sumo los hilos que entran en los grupos del anillo; el resto de
+ *   'thread_count' no se crea (ver crypt_pipeline_groups).
+ * Retorna los bytes escritos o un error negativo. Si stream->checksum no es NULL
+ * deja ahí el CRC32C del archivo cifrado (cabecera, índice y datos).
+ */
+ssize_t crypt_pipeline_run(const struct crypt_stream *stream, int (*threadfn)(void *), const char *namefmt,
+                           const struct crypt_cipher *cipher, int thread_count, struct crypt_job *job)
+{
+    struct crypt_pipeline p = {
+        .stream = stream,
+        .cipher = cipher,
+        .threadfn = threadfn,
+        .job = job,
+        .lz4 = stream->flags & CRYPT_FLAG_LZ4,
+        .in_data_offset = stream->in_offset,
+        .out_data_offset = stream->out_offset,
+        .checksum = stream->checksum != NULL,
+    };
+    struct crypt_pipeline_worker *workers = NULL, *writer;
+    struct task_struct *task;
+    int i, g, w, launched = 0, worker_count;
+    ssize_t ret;
+
+    // Un solo pedazo sin comprimir no tiene nada que solapar
+    if (!p.lz4 && stream->data_size <= CRYPT_PIPELINE_CHUNK)
+        return crypt_pipeline_single(stream, threadfn, namefmt, cipher, thread_count, job);
+
+    crypt_pipeline_layout(&p);
+
+    ret = crypt_pipeline_groups(&p, thread_count);
+    if (ret < 0)
+        return ret;
+    thread_count = ret;
+    worker_count = thread_count + 1; // + el escritor
+    if (p.lz4) {
+        ret = crypt_lz4_index_init(&p);
+        if (ret < 0)
+            goto free_ring;
+    }
+
+    // 1. RESERVAR EL ANILLO: cada buffer en el nodo del grupo que lo cifra.
+    // Todo sale del pool (syscall_crypt_pool.c): los pedazos de la llamada anterior
+    // se reusan y en régimen estable no se reserva memoria.
+    p.slot_count = CRYPT_PIPELINE_DEPTH * p.group_count;
+    p.slots = crypt_pool_zalloc(p.slot_count * sizeof(*p.slots), NUMA_NO_NODE);
+    workers = crypt_pool_zalloc(worker_count * sizeof(*workers), NUMA_NO_NODE);
+    if (!p.slots || !workers) {
+        ret = -ENOMEM;
+        goto free_ring;
+    }
+    for (i = 0; i < p.slot_count; i++) {
+        p.slots[i].state = CRYPT_SLOT_FREE;
+        init_waitqueue_head(&p.slots[i].wait);
+        p.slots[i].buffer = crypt_pool_alloc(CRYPT_PIPELINE_CHUNK, p.groups[i % p.group_count].node);
+        if (!p.slots[i].buffer) {
+            ret = -ENOMEM;
+            goto free_ring;
+        }
+        if (p.lz4) {
+            p.slots[i].output = crypt_pool_alloc(CRYPT_PIPELINE_CHUNK, p.groups[i % p.group_count].node);
+            if (!p.slots[i].output) {
+                ret = -ENOMEM;
+                goto free_ring;
+            }
+        } else if (p.checksum) {
+            p.slots[i].share_crc = crypt_pool_zalloc(p.groups[i % p.group_count].thread_count * sizeof(u32),
+                                                     NUMA_NO_NODE);
+            if (!p.slots[i].share_crc) {
+                ret = -ENOMEM;
+                goto free_ring;
+            }
+        }
+    }
+    // Cada hilo que comprime necesita su propia memoria de trabajo de LZ4
+    if (p.lz4 && !stream->decrypt) {
+        for (i = 0; i < thread_count; i++) {
+            workers[i].lz4_mem = crypt_pool_alloc(LZ4_MEM_COMPRESS, NUMA_NO_NODE);
+            if (!workers[i].lz4_mem) {
+                ret = -ENOMEM;
+                goto free_ring;
+            }
+        }
+    }
+
+    // 2. LANZAR LOS HILOS: los cifradores fijados al nodo de su grupo y el escritor
+    crypt_job_set_phase(job, CRYPT_JOB_PHASE_PROCESSING);
+    for (g = 0, i = 0; g < p.group_count; g++) {
+        for (w = 0; w < p.groups[g].thread_count; w++, i++) {
+            workers[i].pipeline = &p;
+            workers[i].group = g;
+            workers[i].index = w;
+            init_completion(&workers[i].done);
+            task = crypt_start_worker(crypt_pipeline_xor, &workers[i], p.groups[g].node, namefmt, i);
+            if (IS_ERR(task)) {
+                crypt_pipeline_fail(&p, PTR_ERR(task));
+                goto wait_threads;
+            }
+            launched++;
+        }
+    }
+    writer = &workers[i];
+    writer->pipeline = &p;
+    init_completion(&writer->done);
+    task = crypt_start_worker(crypt_pipeline_write, writer, numa_node_id(), "crypt_writer_%d", 0);
+    if (IS_ERR(task)) {
+        crypt_pipeline_fail(&p, PTR_ERR(task));
+        goto wait_threads;
+    }
+    launched++;
+
+    // 3. LEER: el hilo que llamó alimenta el anillo hasta el final del archivo
+    crypt_pipeline_read(&p);
+
+    // 4. ESPERAR A LOS HILOS antes de liberar el anillo que comparten
+wait_threads:
+    for (i = 0; i < launched; i++) {
+        if (wait_for_completion_killable(&workers[i].done)) {
+            crypt_job_cancel(job);
+            crypt_pipeline_fail(&p, -EINTR);
+            wait_for_completion(&workers[i].done);
+        }
+    }
+
+    // 5. Con LZ4, el índice se guarda cuando ya se conocen todos los tamaños
+    if (!p.error && p.lz4 && !stream->decrypt)
+        p.error = crypt_lz4_index_write(&p);
+
+    ret = p.error ? (ssize_t)p.error : (ssize_t)stream->data_size;
+    if (crypt_job_cancelled(job))
+        ret = crypt_job_cancel_error();
+    if (ret >= 0 && p.checksum)
+        *stream->checksum = crypt_pipeline_crc(&p);
+
+free_ring:
+    if (p.slots) {
+        for (i = 0; i < p.slot_count; i++) {
+            crypt_pool_free(p.slots[i].buffer, CRYPT_PIPELINE_CHUNK);
+            crypt_pool_free(p.slots[i].output, CRYPT_PIPELINE_CHUNK);
+            crypt_pool_free(p.slots[i].share_crc, p.groups[i % p.group_count].thread_count * sizeof(u32));
+        }
+    }
+    if (workers) {
+        for (i = 0; i < worker_count; i++)
+            crypt_pool_free(workers[i].lz4_mem, LZ4_MEM_COMPRESS);
+    }
+    crypt_pool_free(p.slots, p.slot_count * sizeof(*p.slots));
+    crypt_pool_free(workers, worker_count * sizeof(*workers));
+    crypt_pool_free(p.groups, p.group_count * sizeof(*p.groups));
+    crypt_pool_free(p.index, p.block_count * sizeof(*p.index));
+    return ret;
+}
@@ -0,0 +1,402 @@
+// kernel/syscall_crypt_pool.c
+// Pool de buffers reutilizables para my_encrypt/my_decrypt (y lo que usa el pipeline).
+// Cada llamada necesitaba la clave, los buffers de 4 MiB del anillo y varios arreglos
+// de control; reservarlos y liberarlos en cada llamada compite por el allocator y, con
+// la memoria fragmentada, las reservas de orden alto empiezan a fallar.
+// Acá se guardan al devolverlos y la siguiente llamada los reusa. Cada pedido va a la
+// clase de tamaño más chica que le alcanza, para no retener 32 KiB por un arreglo de
+// 100 bytes:
+// - Hasta CRYPT_POOL_SMALL (la clave y casi todos los arreglos de control): kmalloc.
+//   El slab ya los guarda en cachés por CPU; otro pool encima solo desperdiciaría.
+// - Hasta una página: páginas sueltas (orden 0).
+// - Hasta CRYPT_POOL_BLOCK (la memoria de trabajo de LZ4, arreglos de muchos hilos):
+//   bloques de vmalloc, armados con páginas de orden 0. Un kmalloc de 32 KiB es de
+//   orden 3 y con la memoria fragmentada es justo el que falla.
+//   Estas dos clases tienen una caché por CPU y, cuando se llena, una lista global.
+// - Pedazos de CRYPT_PIPELINE_CHUNK (más de la mitad de uno): una lista por nodo
+//   NUMA, así un buffer reusado sigue estando cerca de los hilos que lo procesan.
+//   No hay caché por CPU de pedazos: con 4 MiB cada uno retendría demasiado, y el
+//   anillo del pipeline reparte sus buffers por nodo, no por CPU.
+// Entre un bloque y medio pedazo (arreglos grandes, archivos chicos) y más de un
+// pedazo se reserva y libera como antes: darles un pedazo entero retendría 4 MiB por
+// unos KiB y le quitaría lugares al anillo.
+//
+// Parámetros (línea de comandos: syscall_crypt_pool.<nombre>=N, o en
+// /sys/module/syscall_crypt_pool/parameters/):
+// - max_chunks: pedazos guardados por nodo (por defecto, un anillo entero del pipeline)
+// - max_pages / max_blocks: páginas y bloques guardados en las listas globales
+//   (aparte de las cachés por CPU)
+// - reserve_chunks: pedazos por nodo reservados al arrancar (0 = al primer uso)
+// Con poca memoria el shrinker devuelve al sistema lo que no se está usando, también
+// lo que quedó en las cachés por CPU.
+// Aciertos y reservas nuevas de cada clase: cat /sys/kernel/debug/so2_crypt/pool
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/moduleparam.h>
+#include <linux/slab.h>
+#include <linux/mm.h>
+#include <linux/vmalloc.h>
+#include <linux/percpu.h>
+#include <linux/spinlock.h>
+#include <linux/nodemask.h>
+#include <linux/topology.h>
+#include <linux/shrinker.h>
+#include <linux/gfp.h>
+#include <linux/seq_file.h>
+#include "syscall_crypt.h"
+
+static unsigned int max_chunks = CRYPT_PIPELINE_RING_CHUNKS;
+module_param(max_chunks, uint, 0644);
+MODULE_PARM_DESC(max_chunks, "Pedazos de 4 MiB guardados por nodo NUMA");
+
+static unsigned int max_pages = 64;
+module_param(max_pages, uint, 0644);
+MODULE_PARM_DESC(max_pages, "Páginas guardadas en la lista global");
+
+static unsigned int max_blocks = 16;
+module_param(max_blocks, uint, 0644);
+MODULE_PARM_DESC(max_blocks, "Bloques de 32 KiB guardados en la lista global");
+
+static unsigned int reserve_chunks;
+module_param(reserve_chunks, uint, 0444);
+MODULE_PARM_DESC(reserve_chunks, "Pedazos por nodo reservados al arrancar (0 = al primer uso)");
+
+// Un buffer libre guarda en sus primeros bytes el puntero al siguiente
+struct crypt_pool_entry {
+    struct crypt_pool_entry *next;
+};
+
+struct crypt_pool_list {
+    spinlock_t lock;
+    struct crypt_pool_entry *head;
+    unsigned int count;
+};
+
+// Clases de tamaño que se guardan por CPU (y, al final, la de los pedazos por nodo)
+enum {
+    CRYPT_POOL_PAGE,              // PAGE_SIZE, una página de orden 0
+    CRYPT_POOL_VBLOCK,            // CRYPT_POOL_BLOCK, de vmalloc
+    CRYPT_POOL_CLASSES,
+    CRYPT_POOL_CHUNK = CRYPT_POOL_CLASSES, // Solo para los contadores
+    CRYPT_POOL_COUNTERS,
+};
+
+// Por clase: pedidos servidos con un buffer guardado y pedidos que tuvieron que
+// reservar uno nuevo. Por CPU, como los contadores de syscall_crypt_stats.c.
+struct crypt_pool_hits {
+    u64 hits;
+    u64 misses;
+};
+static DEFINE_PER_CPU(struct crypt_pool_hits [CRYPT_POOL_COUNTERS], crypt_pool_hits);
+
+static const char *const crypt_pool_names[CRYPT_POOL_COUNTERS] = {
+    [CRYPT_POOL_PAGE] = "page",
+    [CRYPT_POOL_VBLOCK] = "block",
+    [CRYPT_POOL_CHUNK] = "chunk",
+};
+
+static void crypt_pool_count_hit(int class, bool hit)
+{
+    if (hit)
+        this_cpu_inc(crypt_pool_hits[class].hits);
+    else
+        this_cpu_inc(crypt_pool_hits[class].misses);
+}
+
+// Cuántos guarda cada CPU de cada clase (16 páginas y 4 bloques: 192 KiB con páginas de 4 KiB)
+#define CRYPT_POOL_CPU_MAX 16
+static const unsigned int crypt_pool_cpu_max[CRYPT_POOL_CLASSES] = { 16, 4 };
+
+// Caché de cada CPU. El lock casi nunca se disputa: solo lo toman esta CPU (con la
+// preempción desactivada) y el shrinker, que vacía las cachés de todas.
+struct crypt_pool_cpu {
+    spinlock_t lock;
+    void *buffers[CRYPT_POOL_CLASSES][CRYPT_POOL_CPU_MAX];
+    unsigned int count[CRYPT_POOL_CLASSES];
+};
+
+static DEFINE_PER_CPU(struct crypt_pool_cpu, crypt_pool_cpu);
+static struct crypt_pool_list crypt_pool_global[CRYPT_POOL_CLASSES];
+static struct crypt_pool_list crypt_pool_chunks[MAX_NUMNODES];
+
+static void *crypt_pool_pop(struct crypt_pool_list *list)
+{
+    struct crypt_pool_entry *entry;
+
+    spin_lock(&list->lock);
+    entry = list->head;
+    if (entry) {
+        list->head = entry->next;
+        list->count--;
+    }
+    spin_unlock(&list->lock);
+    return entry;
+}
+
+// Retorna false si la lista ya tiene 'max' buffers (el que llama lo libera)
+static bool crypt_pool_push(struct crypt_pool_list *list, void *ptr, unsigned int max)
+{
+    struct crypt_pool_entry *entry = ptr;
+    bool stored = false;
+
+    spin_lock(&list->lock);
+    if (list->count < max) {
+        entry->next = list->head;
+        list->head = entry;
+        list->count++;
+        stored = true;
+    }
+    spin_unlock(&list->lock);
+    return stored;
+}
+
+// Un buffer nuevo de la clase, y cómo se devuelve al sistema
+static void *crypt_pool_new(int class)
+{
+    if (class == CRYPT_POOL_PAGE)
+        return (void *)__get_free_page(GFP_KERNEL);
+    return vmalloc(CRYPT_POOL_BLOCK);
+}
+
+static void crypt_pool_release(int class, void *ptr)
+{
+    if (class == CRYPT_POOL_PAGE)
+        free_page((unsigned long)ptr);
+    else
+        vfree(ptr);
+}
+
+static unsigned int crypt_pool_global_max(int class)
+{
+    return class == CRYPT_POOL_PAGE ? READ_ONCE(max_pages) : READ_ONCE(max_blocks);
+}
+
+static void *crypt_pool_get(int class)
+{
+    struct crypt_pool_cpu *cache;
+    void *ptr = NULL;
+
+    cache = get_cpu_ptr(&crypt_pool_cpu);
+    spin_lock(&cache->lock);
+    if (cache->count[class])
+        ptr = cache->buffers[class][--cache->count[class]];
+    spin_unlock(&cache->lock);
+    put_cpu_ptr(&crypt_pool_cpu);
+
+    if (!ptr)
+        ptr = crypt_pool_pop(&crypt_pool_global[class]);
+    crypt_pool_count_hit(class, ptr != NULL);
+    if (!ptr)
+        ptr = crypt_pool_new(class);
+    return ptr;
+}
+
+static void crypt_pool_put(int class, void *ptr)
+{
+    struct crypt_pool_cpu *cache;
+    bool stored = false;
+
+    cache = get_cpu_ptr(&crypt_pool_cpu);
+    spin_lock(&cache->lock);
+    if (cache->count[class] < crypt_pool_cpu_max[class]) {
+        cache->buffers[class][cache->count[class]++] = ptr;
+        stored = true;
+    }
+    spin_unlock(&cache->lock);
+    put_cpu_ptr(&crypt_pool_cpu);
+
+    if (!stored && !crypt_pool_push(&crypt_pool_global[class], ptr, crypt_pool_global_max(class)))
+        crypt_pool_release(class, ptr);
+}
+
+// Nodo de la memoria de un pedazo (kvmalloc_node puede haber usado vmalloc)
+static int crypt_pool_node_of(const void *ptr)
+{
+    struct page *page = is_vmalloc_addr(ptr) ? vmalloc_to_page(ptr) : virt_to_page(ptr);
+
+    return page_to_nid(page);
+}
+
+static void *crypt_pool_get_chunk(int node)
+{
+    void *chunk;
+
+    if (node == NUMA_NO_NODE)
+        node = numa_node_id();
+    chunk = crypt_pool_pop(&crypt_pool_chunks[node]);
+    crypt_pool_count_hit(CRYPT_POOL_CHUNK, chunk != NULL);
+    if (!chunk)
+        chunk = kvmalloc_node(CRYPT_PIPELINE_CHUNK, GFP_KERNEL, node);
+    return chunk;
+}
+
+static void crypt_pool_put_chunk(void *chunk)
+{
+    if (!crypt_pool_push(&crypt_pool_chunks[crypt_pool_node_of(chunk)], chunk, READ_ONCE(max_chunks)))
+        kvfree(chunk);
+}
+
+/*
+ * crypt_pool_alloc
+ * Reserva 'size' bytes (sin inicializar) para una syscall de cifrado, de preferencia
+ * en 'node' (NUMA_NO_NODE = el nodo actual). Los pedidos chicos van a kmalloc; hasta
+ * una página, hasta CRYPT_POOL_BLOCK y de medio pedazo a CRYPT_PIPELINE_CHUNK se
+ * reusan buffers del pool; el resto va a kvmalloc_node.
+ * Se devuelve con crypt_pool_free pasando el mismo 'size'.
+ */
+void *crypt_pool_alloc(size_t size, int node)
+{
+    if (size <= CRYPT_POOL_SMALL)
+        return kmalloc_node(size, GFP_KERNEL, node);
+    if (size <= PAGE_SIZE)
+        return crypt_pool_get(CRYPT_POOL_PAGE);
+    if (size <= CRYPT_POOL_BLOCK)
+        return crypt_pool_get(CRYPT_POOL_VBLOCK);
+    if (size > CRYPT_PIPELINE_CHUNK / 2 && size <= CRYPT_PIPELINE_CHUNK)
+        return crypt_pool_get_chunk(node);
+    return kvmalloc_node(size, GFP_KERNEL, node);
+}
+
+void crypt_pool_free(void *ptr, size_t size)
+{
+    if (!ptr)
+        return;
+    if (size <= CRYPT_POOL_SMALL)
+        kfree(ptr);
+    else if (size <= PAGE_SIZE)
+        crypt_pool_put(CRYPT_POOL_PAGE, ptr);
+    else if (size <= CRYPT_POOL_BLOCK)
+        crypt_pool_put(CRYPT_POOL_VBLOCK, ptr);
+    else if (size > CRYPT_PIPELINE_CHUNK / 2 && size <= CRYPT_PIPELINE_CHUNK)
+        crypt_pool_put_chunk(ptr);
+    else
+        kvfree(ptr);
+}
+
+// Lo que el shrinker puede devolver: las listas globales y las cachés por CPU
+static unsigned long crypt_pool_count(struct shrinker *shrinker, struct shrink_control *sc)
+{
+    unsigned long count = 0;
+    int class, node, cpu;
+
+    for (class = 0; class < CRYPT_POOL_CLASSES; class++) {
+        count += READ_ONCE(crypt_pool_global[class].count);
+        for_each_possible_cpu(cpu)
+            count += READ_ONCE(per_cpu_ptr(&crypt_pool_cpu, cpu)->count[class]);
+    }
+    for_each_node(node)
+        count += READ_ONCE(crypt_pool_chunks[node].count);
+    return count ? count : SHRINK_EMPTY;
+}
+
+// Vacía hasta 'max' buffers de 'class' de las cachés de todas las CPUs
+static unsigned long crypt_pool_drain_cpus(int class, unsigned long max)
+{
+    struct crypt_pool_cpu *cache;
+    unsigned long freed = 0;
+    void *ptr;
+    int cpu;
+
+    for_each_possible_cpu(cpu) {
+        cache = per_cpu_ptr(&crypt_pool_cpu, cpu);
+        while (freed < max) {
+            spin_lock(&cache->lock);
+            ptr = cache->count[class] ? cache->buffers[class][--cache->count[class]] : NULL;
+            spin_unlock(&cache->lock);
+            if (!ptr)
+                break;
+            crypt_pool_release(class, ptr);
+            freed++;
+        }
+    }
+    return freed;
+}
+
+// Primero los pedazos (cada uno son 4 MiB), después los bloques y al final las
+// páginas; de cada clase, primero la lista global y después las cachés por CPU
+static unsigned long crypt_pool_scan(struct shrinker *shrinker, struct shrink_control *sc)
+{
+    unsigned long freed = 0;
+    void *ptr;
+    int class, node;
+
+    for_each_node(node) {
+        while (freed < sc->nr_to_scan && (ptr = crypt_pool_pop(&crypt_pool_chunks[node]))) {
+            kvfree(ptr);
+            freed++;
+        }
+    }
+    for (class = CRYPT_POOL_CLASSES - 1; class >= 0; class--) {
+        while (freed < sc->nr_to_scan && (ptr = crypt_pool_pop(&crypt_pool_global[class]))) {
+            crypt_pool_release(class, ptr);
+            freed++;
+        }
+        freed += crypt_pool_drain_cpus(class, sc->nr_to_scan - freed);
+    }
+    return freed ? freed : SHRINK_STOP;
+}
+
+// Para debugfs (so2_crypt/pool, ver syscall_crypt_stats.c): guardados, aciertos y
+// reservas nuevas de cada clase, sumando todas las CPUs
+void crypt_pool_show(struct seq_file *m)
+{
+    struct crypt_pool_hits total, *hits;
+    unsigned long stored;
+    int class, cpu, node;
+
+    seq_printf(m, "%-8s %10s %16s %16s\n", "class", "stored", "hits", "misses");
+    for (class = 0; class < CRYPT_POOL_COUNTERS; class++) {
+        memset(&total, 0, sizeof(total));
+        for_each_possible_cpu(cpu) {
+            hits = &per_cpu(crypt_pool_hits, cpu)[class];
+            total.hits += READ_ONCE(hits->hits);
+            total.misses += READ_ONCE(hits->misses);
+        }
+        stored = 0;
+        if (class == CRYPT_POOL_CHUNK) {
+            for_each_node(node)
+                stored += READ_ONCE(crypt_pool_chunks[node].count);
+        } else {
+            stored = READ_ONCE(crypt_pool_global[class].count);
+            for_each_possible_cpu(cpu)
+                stored += READ_ONCE(per_cpu_ptr(&crypt_pool_cpu, cpu)->count[class]);
+        }
+        seq_printf(m, "%-8s %10lu %16llu %16llu\n", crypt_pool_names[class], stored, total.hits, total.misses);
+    }
+}
+
+static int __init crypt_pool_init(void)
+{
+    struct shrinker *shrinker;
+    unsigned int i;
+    void *chunk;
+    int class, node, cpu;
+
+    for (class = 0; class < CRYPT_POOL_CLASSES; class++)
+        spin_lock_init(&crypt_pool_global[class].lock);
+    for_each_possible_cpu(cpu)
+        spin_lock_init(&per_cpu_ptr(&crypt_pool_cpu, cpu)->lock);
+    for (node = 0; node < MAX_NUMNODES; node++)
+        spin_lock_init(&crypt_pool_chunks[node].lock);
+
+    // Reserva al arrancar, mientras la memoria todavía no está fragmentada
+    for_each_node_state(node, N_MEMORY) {
+        for (i = 0; i < min(reserve_chunks, max_chunks); i++) {
+            chunk = kvmalloc_node(CRYPT_PIPELINE_CHUNK, GFP_KERNEL, node);
+            if (!chunk)
+                break;
+            crypt_pool_put_chunk(chunk);
+        }
+    }
+
+    shrinker = shrinker_alloc(0, "so2_crypt_pool");
+    if (!shrinker) {
+        printk(KERN_WARNING "so2_crypt_pool: sin shrinker, el pool no se achica con poca memoria\n");
+        return 0;
+    }
+    shrinker->count_objects = crypt_pool_count;
+    shrinker->scan_objects = crypt_pool_scan;
+    shrinker_register(shrinker);
+    return 0;
+}
+late_initcall(crypt_pool_init);
@@ -0,0 +1,96 @@
+// kernel/syscall_crypt_stats.c
+// Contadores por CPU de las syscalls de cifrado, exportados en debugfs:
+//   cat /sys/kernel/debug/so2_crypt/stats
+//   cat /sys/kernel/debug/so2_crypt/pool   (buffers reusados, ver syscall_crypt_pool.c)
+// Cada llamada solo suma en los contadores de su CPU (sin locks ni líneas de caché
+// compartidas); al leer el archivo se suman todas las CPUs.
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/percpu.h>
+#include <linux/cpumask.h>
+#include <linux/timekeeping.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include "syscall_crypt.h"
+
+#define CREATE_TRACE_POINTS
+#include "syscall_crypt_trace.h"
+
+struct crypt_stats {
+    u64 calls;
+    u64 bytes;                    // Bytes procesados por las llamadas exitosas
+    u64 ns;                       // Tiempo total dentro de la syscall
+    u64 errors;
+};
+
+static DEFINE_PER_CPU(struct crypt_stats [CRYPT_STAT_COUNT], crypt_stats);
+
+static const char *const crypt_stat_names[CRYPT_STAT_COUNT] = {
+    [CRYPT_STAT_ENCRYPT] = "my_encrypt",
+    [CRYPT_STAT_DECRYPT] = "my_decrypt",
+    [CRYPT_STAT_DECRYPT_RANGE] = "my_decrypt_range",
+    [CRYPT_STAT_BUFFER] = "my_crypt_buffer",
+};
+
+// Al entrar a la syscall: retorna la marca de tiempo que después recibe crypt_stats_end
+u64 crypt_stats_begin(int op)
+{
+    trace_crypt_syscall_start(op);
+    return ktime_get_ns();
+}
+
+// Al salir: 'ret' es lo que retorna la syscall (bytes procesados o un error negativo)
+void crypt_stats_end(int op, u64 start_ns, long ret)
+{
+    u64 ns = ktime_get_ns() - start_ns;
+
+    this_cpu_inc(crypt_stats[op].calls);
+    this_cpu_add(crypt_stats[op].ns, ns);
+    if (ret < 0)
+        this_cpu_inc(crypt_stats[op].errors);
+    else
+        this_cpu_add(crypt_stats[op].bytes, ret);
+
+    trace_crypt_syscall_end(op, ret, ns);
+}
+
+static int crypt_stats_show(struct seq_file *m, void *v)
+{
+    struct crypt_stats total, *stats;
+    int op, cpu;
+
+    seq_printf(m, "%-18s %12s %20s %20s %12s\n", "syscall", "calls", "bytes", "ns", "errors");
+    for (op = 0; op < CRYPT_STAT_COUNT; op++) {
+        memset(&total, 0, sizeof(total));
+        // Una CPU puede estar sumando mientras leemos: cada contador se lee entero
+        for_each_possible_cpu(cpu) {
+            stats = &per_cpu(crypt_stats, cpu)[op];
+            total.calls += READ_ONCE(stats->calls);
+            total.bytes += READ_ONCE(stats->bytes);
+            total.ns += READ_ONCE(stats->ns);
+            total.errors += READ_ONCE(stats->errors);
+        }
+        seq_printf(m, "%-18s %12llu %20llu %20llu %12llu\n", crypt_stat_names[op],
+                   total.calls, total.bytes, total.ns, total.errors);
+    }
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(crypt_stats);
+
+static int crypt_pool_stats_show(struct seq_file *m, void *v)
+{
+    crypt_pool_show(m);
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(crypt_pool_stats);
+
+static int __init crypt_stats_init(void)
+{
+    struct dentry *dir;
+
+    dir = debugfs_create_dir("so2_crypt", NULL);
+    debugfs_create_file("stats", 0444, dir, NULL, &crypt_stats_fops);
+    debugfs_create_file("pool", 0444, dir, NULL, &crypt_pool_stats_fops);
+    return 0;
+}
+late_initcall(crypt_stats_init);
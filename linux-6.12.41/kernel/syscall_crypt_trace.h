@@ -0,0 +1,85 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+// kernel/syscall_crypt_trace.h
+// Tracepoints de my_encrypt/my_decrypt/my_decrypt_range/my_crypt_buffer.
+// Se activan con ftrace o perf (events/so2_crypt/*); apagados solo cuestan un salto.
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM so2_crypt
+
+#if !defined(_KERNEL_SYSCALL_CRYPT_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _KERNEL_SYSCALL_CRYPT_TRACE_H
+
+#include <linux/tracepoint.h>
+
+#define show_crypt_op(op)                                       \
+    __print_symbolic(op,                                        \
+                     { CRYPT_STAT_ENCRYPT, "my_encrypt" },      \
+                     { CRYPT_STAT_DECRYPT, "my_decrypt" },      \
+                     { CRYPT_STAT_DECRYPT_RANGE, "my_decrypt_range" }, \
+                     { CRYPT_STAT_BUFFER, "my_crypt_buffer" })
+
+TRACE_EVENT(crypt_syscall_start,
+    TP_PROTO(int op),
+    TP_ARGS(op),
+
+    TP_STRUCT__entry(
+        __field(int, op)
+    ),
+
+    TP_fast_assign(
+        __entry->op = op;
+    ),
+
+    TP_printk("%s", show_crypt_op(__entry->op))
+);
+
+TRACE_EVENT(crypt_syscall_end,
+    TP_PROTO(int op, long ret, u64 ns),
+    TP_ARGS(op, ret, ns),
+
+    TP_STRUCT__entry(
+        __field(int, op)
+        __field(long, ret)
+        __field(u64, ns)
+    ),
+
+    TP_fast_assign(
+        __entry->op = op;
+        __entry->ret = ret;
+        __entry->ns = ns;
+    ),
+
+    TP_printk("%s ret=%ld ns=%llu", show_crypt_op(__entry->op), __entry->ret,
+              (unsigned long long)__entry->ns)
+);
+
+// Un pedazo procesado por un hilo: dónde empieza en los datos, cuántos bytes y cuánto tardó
+TRACE_EVENT(crypt_fragment,
+    TP_PROTO(bool decrypt, u64 pos, size_t bytes, u64 ns),
+    TP_ARGS(decrypt, pos, bytes, ns),
+
+    TP_STRUCT__entry(
+        __field(bool, decrypt)
+        __field(u64, pos)
+        __field(size_t, bytes)
+        __field(u64, ns)
+    ),
+
+    TP_fast_assign(
+        __entry->decrypt = decrypt;
+        __entry->pos = pos;
+        __entry->bytes = bytes;
+        __entry->ns = ns;
+    ),
+
+    TP_printk("%s pos=%llu bytes=%zu ns=%llu", __entry->decrypt ? "decrypt" : "encrypt",
+              (unsigned long long)__entry->pos, __entry->bytes, (unsigned long long)__entry->ns)
+);
+
+#endif /* _KERNEL_SYSCALL_CRYPT_TRACE_H */
+
+// El header no está en include/trace/events: define_trace.h lo busca en este directorio
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE syscall_crypt_trace
+#include <trace/define_trace.h>
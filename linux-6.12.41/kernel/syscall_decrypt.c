@@ -7,38 +7,36 @@
 #include <linux/delay.h>
 #include <linux/completion.h>
 #include <linux/string.h>
-
-// Estructura que define "un pedazo" de trabajo para un hilo.
-typedef struct {
-    unsigned char *buffer;          // Puntero a los datos completos del archivo en RAM
-    size_t data_size;               // Tamaño total
-    unsigned char *encryption_key;  // Puntero a la clave en RAM
-    size_t key_length;              // Largo de la clave
-    size_t start_idx;               // Byte donde este hilo empieza a trabajar
-    size_t end_idx;                 // Byte donde este hilo termina
-} DataFragment;
-
-// Estructura para coordinar el hilo.
-struct task_params {
-    DataFragment data_fragment;     // Los datos que el hilo va a procesar
-    struct completion completed_event; // Una "señal" para avisar cuando termine
-};
+#include <linux/timekeeping.h>
+#include "syscall_crypt.h"
+#include "syscall_crypt_trace.h"
 
 // --- EL NÚCLEO DE LA OPERACIÓN (MISMO CÓDIGO XOR) ---
 int perform_xor_decryption(void *arg) {
     struct task_params *params = (struct task_params *)arg;
     DataFragment *fragment = &params->data_fragment;
-    size_t i;
-
-    printk(KERN_INFO "Decryption Thread iniciado: start_idx=%zu, end_idx=%zu\n", fragment->start_idx, fragment->end_idx);
-
-    // Bucle principal: Recorre SOLO la sección del archivo asignada a este hilo
-    for (i = fragment->start_idx; i < fragment->end_idx; i++) {
-        // OPERACIÓN XOR (^=): La misma lógica para encriptar y desencriptar.
-        fragment->buffer[i] ^= fragment->encryption_key[i % fragment->key_length];
+    size_t i, step;
+    // Solo se mide el tiempo si alguien está mirando el tracepoint
+    u64 start_ns = trace_crypt_fragment_enabled() ? ktime_get_ns() : 0;
+
+    // OPERACIÓN DE DESCIFRADO: el mismo keystream que al cifrar (XOR es su propia inversa).
+    // Recorre SOLO la sección del archivo asignada a este hilo, empezando en su posición real.
+    // Se avanza de a CRYPT_PROGRESS_STEP bytes para publicar el progreso y
+    // dejar de trabajar pronto si cancelaron el trabajo. El checksum se calcula
+    // sobre el bloque todavía cifrado, justo antes de descifrarlo.
+    for (i = fragment->start_idx; i < fragment->end_idx; i += step) {
+        if (crypt_job_cancelled(fragment->job))
+            break;
+        step = min_t(size_t, fragment->end_idx - i, CRYPT_PROGRESS_STEP);
+        if (fragment->checksum)
+            fragment->crc = crypt_crc_update(fragment->crc, fragment->buffer + i, step);
+        crypt_apply_keystream(fragment->cipher, fragment->buffer + i, step, fragment->file_offset + i);
+        crypt_job_add_progress(fragment->job, step);
     }
 
-    printk(KERN_INFO "Decryption Thread finalizado: start_idx=%zu, end_idx=%zu\n", fragment->start_idx, fragment->end_idx);
+    if (start_ns && trace_crypt_fragment_enabled())
+        trace_crypt_fragment(true, fragment->file_offset + fragment->start_idx,
+                             fragment->end_idx - fragment->start_idx, ktime_get_ns() - start_ns);
     
     // Avisa al hilo principal que este trabajador ha terminado
     complete(&params->completed_event);
@@ -46,41 +44,47 @@ int perform_xor_decryption(void *arg) {
 }
 
 // Función principal que prepara todo antes de lanzar los hilos
-int handle_file_decryption(const char *input_filepath, const char *output_filepath, const char *key_filepath, int thread_count) {
+// Si 'checksum' no es NULL deja ahí el CRC32C del archivo cifrado (cabecera, índice y datos). Con CRYPT_FLAG_VERIFY
+// en cambio trae el valor esperado, y si no coincide se borra la salida y se retorna -EBADMSG.
+long handle_file_decryption(const char *input_filepath, const char *output_filepath, const char *key_filepath, int thread_count, int mode, u32 *checksum) {
     struct file *input_file, *output_file, *key_file; // Punteros a los archivos en el kernel
     loff_t in_offset = 0, out_offset = 0, key_offset = 0; // Posición de lectura/escritura (cursor)
-    unsigned char *encryption_key, *file_buffer; // Buffers para guardar datos en RAM
+    unsigned char *encryption_key = NULL; // Buffer para guardar la clave en RAM
+    struct crypt_cipher cipher;           // Modo de cifrado + clave preparada
+    u8 nonce[CRYPT_NONCE_SIZE] = { 0 };
+    u64 data_size;
+    struct crypt_stream stream;            // Archivos y posiciones para el pipeline
     size_t file_size, key_length;
-    
-    // Arrays para gestionar los múltiples hilos
-    struct task_params *task_list;
-    struct task_struct **thread_list;
-    DataFragment *fragment_list;
-    
-    size_t fragment_size, extra_bytes;
-    int i, ret_val = 0;
+    struct crypt_job job;                  // Progreso visible con crypt_job_ctl
+    bool output_created = false;           // La salida no existía antes de esta llamada
+    u32 header_crc = CRYPT_CRC_SEED;       // CRC de la cabecera, el checksum sigue con el índice y los datos
+    unsigned int flags = mode & CRYPT_FLAGS_MASK; // CRYPT_FLAG_* que vienen junto al modo
+    u32 expected = (flags & CRYPT_FLAG_VERIFY) ? *checksum : 0;
+    long ret_val = 0;
+
+    mode &= CRYPT_MODE_MASK;
 
-    printk(KERN_INFO "Intentando descifrar: Abrir archivos\n");
+    crypt_job_init(&job);
 
     // 1. ABRIR ARCHIVOS
     input_file = filp_open(input_filepath, O_RDONLY, 0);
-    output_file = filp_open(output_filepath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    output_file = crypt_open_output(output_filepath, &output_created);
     key_file = filp_open(key_filepath, O_RDONLY, 0);
 
     // Verificación de errores al abrir archivos
     if (IS_ERR(input_file)) {
         ret_val = PTR_ERR(input_file);
-        printk(KERN_ERR "Error al abrir el archivo cifrado de entrada: %d\n", ret_val);
+        printk(KERN_ERR "Error al abrir el archivo cifrado de entrada: %ld\n", ret_val);
         goto exit;
     }
     if (IS_ERR(output_file)) {
         ret_val = PTR_ERR(output_file);
-        printk(KERN_ERR "Error al abrir el archivo de salida para descifrado: %d\n", ret_val);
+        printk(KERN_ERR "Error al abrir el archivo de salida para descifrado: %ld\n", ret_val);
         goto close_input_file;
     }
     if (IS_ERR(key_file)) {
         ret_val = PTR_ERR(key_file);
-        printk(KERN_ERR "Error al abrir el archivo de la clave: %d\n", ret_val);
+        printk(KERN_ERR "Error al abrir el archivo de la clave: %ld\n", ret_val);
         goto close_output_file;
     }
 
@@ -92,7 +96,7 @@ int handle_file_decryption(const char *input_filepath, const char *output_filepa
         goto close_key_file;
     }
 
-    encryption_key = kmalloc(key_length, GFP_KERNEL);
+    encryption_key = crypt_pool_alloc(key_length, NUMA_NO_NODE);
     if (!encryption_key) {
         ret_val = -ENOMEM;
         goto close_key_file;
@@ -101,82 +105,91 @@ int handle_file_decryption(const char *input_filepath, const char *output_filepa
     ret_val = kernel_read(key_file, encryption_key, key_length, &key_offset);
     if (ret_val < 0) goto free_encryption_key;
 
-    // 3. LEER EL ARCHIVO DE ENTRADA (DATOS A DESCIFRAR)
+    // 3. CABECERA Y TAMAÑO DE LOS DATOS A DESCIFRAR
     file_size = i_size_read(file_inode(input_file));
+
+    // Los modos con cabecera (y todos los archivos comprimidos) traen el nonce al
+    // inicio; los datos empiezan después
+    if (crypt_mode_has_header(mode) || (flags & CRYPT_FLAG_LZ4)) {
+        ret_val = crypt_header_read(input_file, mode, (flags & CRYPT_FLAG_LZ4) ? CRYPT_HEADER_LZ4 : 0,
+                                    nonce, &data_size, &in_offset, &header_crc);
+        if (ret_val < 0) {
+            printk(KERN_ERR "Error: Cabecera de cifrado invalida: %ld\n", ret_val);
+            goto free_encryption_key;
+        }
+        // Sin comprimir el tamaño se puede validar ya; con LZ4 lo valida el pipeline con el índice
+        if (!(flags & CRYPT_FLAG_LZ4) && file_size - sizeof(struct crypt_file_header) != data_size) {
+            ret_val = -EBADMSG; // Archivo truncado o con basura al final
+            goto free_encryption_key;
+        }
+        file_size = data_size;
+    } else {
+        // XOR sin cabecera: un archivo comprimido pide CRYPT_FLAG_LZ4 (si no, saldría basura)
+        ret_val = crypt_header_reject_lz4(input_file);
+        if (ret_val < 0) {
+            printk(KERN_ERR "Error: El archivo esta comprimido y falta CRYPT_FLAG_LZ4\n");
+            goto free_encryption_key;
+        }
+    }
+
     if (file_size <= 0) {
         ret_val = -EINVAL;
         printk(KERN_ERR "Error: El archivo cifrado esta vacio o es invalido.\n");
         goto free_encryption_key;
     }
-
-    file_buffer = kmalloc(file_size, GFP_KERNEL);
-    if (!file_buffer) {
-        ret_val = -ENOMEM;
+    // El contador de bloque de ChaCha20 no alcanza para más (se repetiría el keystream)
+    if (mode == CRYPT_MODE_CHACHA20 && file_size > CRYPT_CHACHA_MAX_BYTES) {
+        ret_val = -EFBIG;
         goto free_encryption_key;
     }
 
-    ret_val = kernel_read(input_file, file_buffer, file_size, &in_offset);
-    if (ret_val < 0) goto free_file_buffer;
-
-    // 4. PREPARAR HILOS (MULTITHREADING)
-    thread_list = kmalloc(sizeof(struct task_struct *) * thread_count, GFP_KERNEL);
-    task_list = kmalloc(sizeof(struct task_params) * thread_count, GFP_KERNEL);
-    fragment_list = kmalloc(sizeof(DataFragment) * thread_count, GFP_KERNEL);
-
-    if (!thread_list || !task_list || !fragment_list) {
-        ret_val = -ENOMEM;
-        goto free_file_buffer;
-    }
+    ret_val = crypt_cipher_init(&cipher, mode, encryption_key, key_length, nonce);
+    if (ret_val < 0) goto free_encryption_key;
 
-    // Calculamos cuánto trabajo le toca a cada hilo
-    fragment_size = file_size / thread_count;
-    extra_bytes = file_size % thread_count;
-
-    // Bucle para crear y lanzar cada hilo
-    for (i = 0; i < thread_count; i++) {
-        fragment_list[i].buffer = file_buffer;
-        fragment_list[i].data_size = file_size;
-        fragment_list[i].encryption_key = encryption_key;
-        fragment_list[i].key_length = key_length;
-        
-        fragment_list[i].start_idx = (size_t)i * fragment_size;
-        fragment_list[i].end_idx = (i == thread_count - 1) 
-                                 ? (size_t)(i + 1) * fragment_size + extra_bytes 
-                                 : (size_t)(i + 1) * fragment_size;
-
-        task_list[i].data_fragment = fragment_list[i];
-        init_completion(&task_list[i].completed_event);
-
-        // kthread_run crea y arranca el hilo inmediatamente
-        thread_list[i] = kthread_run(perform_xor_decryption, &task_list[i], "xor_decrypt_thread_%d", i);
-        if (IS_ERR(thread_list[i])) {
-            ret_val = PTR_ERR(thread_list[i]);
-            goto free_all_resources;
-        }
+    // thread_count == 0: el kernel elige según el tamaño, las CPUs y la carga actual
+    thread_count = crypt_resolve_threads(thread_count, file_size);
+    if (thread_count < 0) {
+        ret_val = thread_count;
+        goto free_encryption_key;
     }
 
-    // 5. ESPERAR A LOS HILOS (SINCRONIZACIÓN)
-    for (i = 0; i < thread_count; i++) {
-        wait_for_completion(&task_list[i].completed_event);
+    // Desde aquí el trabajo es visible (y cancelable) con crypt_job_ctl
+    crypt_job_begin(&job, file_size);
+
+    // 4. LEER, DESCIFRAR Y ESCRIBIR SOLAPADOS (ver syscall_crypt_pipeline.c)
+    stream.input = input_file;
+    stream.in_offset = in_offset;
+    stream.output = output_file;
+    stream.out_offset = out_offset;
+    stream.data_size = file_size;
+    stream.flags = flags;
+    stream.decrypt = true;
+    stream.checksum = checksum;
+    stream.header_crc = header_crc;
+    ret_val = crypt_pipeline_run(&stream, perform_xor_decryption, "xor_decrypt_thread_%d", &cipher, thread_count, &job);
+
+    // 5. VERIFICAR: el checksum salió de la misma pasada, sin volver a leer la entrada
+    if (ret_val >= 0 && (flags & CRYPT_FLAG_VERIFY) && *checksum != expected) {
+        printk(KERN_ERR "Checksum incorrecto: esperado %08x, calculado %08x\n", expected, *checksum);
+        ret_val = -EBADMSG;
+        crypt_remove_output(output_file, output_created);
     }
-
-    // 6. GUARDAR RESULTADO DESCIFRADO
-    ret_val = kernel_write(output_file, file_buffer, file_size, &out_offset);
     if (ret_val < 0) {
-        printk(KERN_ERR "Error al escribir el archivo descifrado: %d\n", ret_val);
+        printk(KERN_ERR "Error al descifrar el archivo: %ld\n", ret_val);
+        // Un trabajo cancelado no deja un archivo de salida a medio escribir
+        if (ret_val == -ECANCELED || ret_val == -EINTR)
+            crypt_remove_output(output_file, output_created);
     }
 
-// 7. LIMPIEZA DE MEMORIA
-free_all_resources:
-    if (thread_list) kfree(thread_list);
-    if (task_list) kfree(task_list);
-    if (fragment_list) kfree(fragment_list);
-
-free_file_buffer:
-    if (file_buffer) kfree(file_buffer);
-
+// 6. LIMPIEZA DE MEMORIA
 free_encryption_key:
-    if (encryption_key) kfree(encryption_key);
+    crypt_job_end(&job);
+    memzero_explicit(&cipher, sizeof(cipher));
+    if (encryption_key) {
+        // La clave no puede quedar en un buffer que después usa otra llamada
+        memzero_explicit(encryption_key, key_length);
+        crypt_pool_free(encryption_key, key_length);
+    }
 
 close_key_file:
     if (key_file && !IS_ERR(key_file)) filp_close(key_file, NULL);
@@ -191,10 +204,20 @@ exit:
     return ret_val;
 }
 
-// Definición de la System Call (lo que llama el usuario)
-SYSCALL_DEFINE4(my_decrypt, const char __user *, input_filepath, const char __user *, output_filepath, const char __user *, key_filepath, int, thread_count) {
+static long do_my_decrypt(const char __user *input_filepath, const char __user *output_filepath, const char __user *key_filepath, int thread_count, int mode, u32 __user *checksum) {
     char *k_input_filepath = NULL, *k_output_filepath = NULL, *k_key_filepath = NULL;
-    int ret_val;
+    u32 k_checksum = 0;
+    long ret_val;
+
+    // Debe ser el mismo modo con el que se cifró el archivo (más banderas CRYPT_FLAG_*)
+    if (mode & ~(CRYPT_MODE_MASK | CRYPT_FLAGS_MASK))
+        return -EINVAL;
+    if ((mode & CRYPT_FLAG_VERIFY) && !checksum)
+        return -EINVAL;
+    if (checksum && !IS_REACHABLE(CONFIG_CRC32))
+        return -EOPNOTSUPP;
+    if ((mode & CRYPT_FLAG_VERIFY) && get_user(k_checksum, checksum))
+        return -EFAULT;
 
     // COPIAR DATOS DE USUARIO A KERNEL
     k_input_filepath = strndup_user(input_filepath, PATH_MAX);
@@ -208,7 +231,10 @@ SYSCALL_DEFINE4(my_decrypt, const char __user *, input_filepath, const char __us
     }
 
     // Llamar a la función lógica de desencriptación
-    ret_val = handle_file_decryption(k_input_filepath, k_output_filepath, k_key_filepath, thread_count);
+    ret_val = handle_file_decryption(k_input_filepath, k_output_filepath, k_key_filepath, thread_count, mode,
+                                     checksum ? &k_checksum : NULL);
+    if (ret_val >= 0 && checksum && !(mode & CRYPT_FLAG_VERIFY) && put_user(k_checksum, checksum))
+        ret_val = -EFAULT;
 
 free_memory:
     if (!IS_ERR_OR_NULL(k_input_filepath)) kfree(k_input_filepath);
@@ -216,4 +242,16 @@ free_memory:
     if (!IS_ERR_OR_NULL(k_key_filepath)) kfree(k_key_filepath);
 
     return ret_val;
-}
\ No newline at end of file
+}
+
+// Definición de la System Call (lo que llama el usuario)
+// 'checksum' (opcional, puede ser NULL): recibe el CRC32C del archivo cifrado entero, o con
+// CRYPT_FLAG_VERIFY trae el que devolvió my_encrypt para comprobar el archivo.
+SYSCALL_DEFINE6(my_decrypt, const char __user *, input_filepath, const char __user *, output_filepath, const char __user *, key_filepath, int, thread_count, int, mode, u32 __user *, checksum) {
+    u64 start_ns = crypt_stats_begin(CRYPT_STAT_DECRYPT);
+    long ret_val;
+
+    ret_val = do_my_decrypt(input_filepath, output_filepath, key_filepath, thread_count, mode, checksum);
+    crypt_stats_end(CRYPT_STAT_DECRYPT, start_ns, ret_val);
+    return ret_val;
+}
@@ -0,0 +1,189 @@
+// kernel/my_decrypt_range.c
+// Descifra solo un rango [offset, offset + length) de un archivo cifrado con my_encrypt
+// y lo copia directo al buffer del usuario: leer un registro cuesta O(rango), no O(archivo).
+#include <linux/syscalls.h>
+#include <linux/fs.h>
+#include <linux/uaccess.h>
+#include <linux/slab.h>
+#include <linux/minmax.h>
+#include <linux/sched/signal.h>
+#include "syscall_crypt.h"
+
+// Tamaño del buffer intermedio: el rango se procesa por pedazos de este tamaño.
+// Sale de crypt_pool_alloc (kvmalloc por ser mediano): no pide 256 KiB contiguos.
+#define CRYPT_RANGE_CHUNK (256UL << 10) // 256 KiB
+
+// Función principal: descifra el rango pedido y lo copia al usuario
+long handle_range_decryption(const char *input_filepath, const char *key_filepath, loff_t offset,
+                             size_t length, void __user *user_buffer, int mode) {
+    struct file *input_file, *key_file;
+    loff_t key_offset = 0, in_offset = 0, data_start = 0;
+    unsigned char *encryption_key = NULL, *chunk_buffer = NULL;
+    struct crypt_cipher cipher;
+    u8 nonce[CRYPT_NONCE_SIZE] = { 0 };
+    u64 data_size;
+    size_t key_length, done = 0, chunk, buffer_size = 0;
+    ssize_t bytes_read;
+    long ret_val = 0;
+
+    // 1. ABRIR ARCHIVOS
+    input_file = filp_open(input_filepath, O_RDONLY, 0);
+    if (IS_ERR(input_file)) {
+        ret_val = PTR_ERR(input_file);
+        printk(KERN_ERR "Error al abrir el archivo cifrado de entrada: %ld\n", ret_val);
+        goto exit;
+    }
+    key_file = filp_open(key_filepath, O_RDONLY, 0);
+    if (IS_ERR(key_file)) {
+        ret_val = PTR_ERR(key_file);
+        printk(KERN_ERR "Error al abrir el archivo de la clave: %ld\n", ret_val);
+        goto close_input_file;
+    }
+
+    // 2. LEER LA CLAVE
+    key_length = i_size_read(file_inode(key_file));
+    if (key_length <= 0) {
+        ret_val = -EINVAL;
+        goto close_key_file;
+    }
+    encryption_key = crypt_pool_alloc(key_length, NUMA_NO_NODE);
+    if (!encryption_key) {
+        ret_val = -ENOMEM;
+        goto close_key_file;
+    }
+    ret_val = kernel_read(key_file, encryption_key, key_length, &key_offset);
+    if (ret_val < 0) goto free_encryption_key;
+
+    // 3. UBICAR LOS DATOS: los modos con cabecera traen el nonce y los datos empiezan después
+    data_size = i_size_read(file_inode(input_file));
+    if (crypt_mode_has_header(mode)) {
+        ret_val = crypt_header_read(input_file, mode, 0, nonce, &data_size, &in_offset, NULL);
+        if (ret_val < 0) goto free_encryption_key;
+        data_start = in_offset;
+    } else {
+        // Un archivo XOR comprimido no tiene posiciones fijas: no se puede leer un rango
+        ret_val = crypt_header_reject_lz4(input_file);
+        if (ret_val < 0) goto free_encryption_key;
+    }
+    // El contador de bloque de ChaCha20 no alcanza para más (se repetiría el keystream)
+    if (mode == CRYPT_MODE_CHACHA20 && data_size > CRYPT_CHACHA_MAX_BYTES) {
+        ret_val = -EFBIG;
+        goto free_encryption_key;
+    }
+
+    ret_val = crypt_cipher_init(&cipher, mode, encryption_key, key_length, nonce);
+    if (ret_val < 0) goto free_encryption_key;
+
+    // Un rango que empieza después del final no tiene datos; uno que se pasa se recorta
+    if (offset >= data_size) {
+        ret_val = 0;
+        goto free_encryption_key;
+    }
+    length = min_t(u64, length, data_size - offset);
+
+    buffer_size = min_t(size_t, length, CRYPT_RANGE_CHUNK);
+    chunk_buffer = crypt_pool_alloc(buffer_size, NUMA_NO_NODE);
+    if (!chunk_buffer) {
+        ret_val = -ENOMEM;
+        goto free_encryption_key;
+    }
+
+    // 4. LEER, DESCIFRAR Y COPIAR POR PEDAZOS
+    // El keystream se posiciona en offset + done: el mismo byte que usó my_encrypt.
+    while (done < length) {
+        // Un rango grande son muchos pedazos: un kill no espera a que terminen
+        if (fatal_signal_pending(current)) {
+            ret_val = -EINTR;
+            goto free_chunk_buffer;
+        }
+        chunk = min_t(size_t, length - done, CRYPT_RANGE_CHUNK);
+        in_offset = data_start + offset + done;
+
+        bytes_read = kernel_read(input_file, chunk_buffer, chunk, &in_offset);
+        if (bytes_read < 0) {
+            ret_val = bytes_read;
+            goto free_chunk_buffer;
+        }
+        if (bytes_read == 0)
+            break; // El archivo es más corto de lo que dice la cabecera
+
+        crypt_apply_keystream(&cipher, chunk_buffer, bytes_read, offset + done);
+
+        if (copy_to_user((unsigned char __user *)user_buffer + done, chunk_buffer, bytes_read)) {
+            ret_val = -EFAULT;
+            goto free_chunk_buffer;
+        }
+        done += bytes_read;
+    }
+    // Retornamos la cantidad de bytes descifrados
+    ret_val = done;
+
+free_chunk_buffer:
+    // Texto descifrado: no puede quedar en un buffer que después usa otra llamada
+    memzero_explicit(chunk_buffer, buffer_size);
+    crypt_pool_free(chunk_buffer, buffer_size);
+
+free_encryption_key:
+    memzero_explicit(&cipher, sizeof(cipher));
+    memzero_explicit(encryption_key, key_length);
+    crypt_pool_free(encryption_key, key_length);
+
+close_key_file:
+    filp_close(key_file, NULL);
+
+close_input_file:
+    filp_close(input_file, NULL);
+
+exit:
+    return ret_val;
+}
+
+static long do_my_decrypt_range(const char __user *input_filepath, const char __user *key_filepath,
+                                loff_t offset, size_t length, void __user *buf, int mode) {
+    char *k_input_filepath = NULL, *k_key_filepath = NULL;
+    long ret_val;
+
+    // 1. VALIDACIONES
+    if (mode & ~CRYPT_MODE_MASK)
+        return -EINVAL;
+    if (offset < 0 || !buf)
+        return -EINVAL;
+    if (length == 0)
+        return 0;
+    if (!access_ok(buf, length))
+        return -EFAULT;
+
+    // 2. COPIAR RUTAS DE USUARIO A KERNEL
+    k_input_filepath = strndup_user(input_filepath, PATH_MAX);
+    k_key_filepath = strndup_user(key_filepath, PATH_MAX);
+    if (IS_ERR(k_input_filepath) || IS_ERR(k_key_filepath)) {
+        ret_val = -EFAULT;
+        goto free_memory;
+    }
+
+    ret_val = handle_range_decryption(k_input_filepath, k_key_filepath, offset, length, buf, mode);
+
+free_memory:
+    if (!IS_ERR_OR_NULL(k_input_filepath)) kfree(k_input_filepath);
+    if (!IS_ERR_OR_NULL(k_key_filepath)) kfree(k_key_filepath);
+
+    return ret_val;
+}
+
+/*
+ * SYSCALL_DEFINE6: my_decrypt_range
+ * - input_filepath / key_filepath: igual que en my_decrypt
+ * - offset, length: rango a descifrar, en bytes de los datos originales
+ * - buf: buffer de usuario de al menos 'length' bytes
+ * - mode: el mismo modo con el que se cifró (CRYPT_MODE_*)
+ * Retorna la cantidad de bytes copiados a 'buf' (menos que 'length' si el rango pasa el final).
+ */
+SYSCALL_DEFINE6(my_decrypt_range, const char __user *, input_filepath, const char __user *, key_filepath,
+                loff_t, offset, size_t, length, void __user *, buf, int, mode) {
+    u64 start_ns = crypt_stats_begin(CRYPT_STAT_DECRYPT_RANGE);
+    long ret_val;
+
+    ret_val = do_my_decrypt_range(input_filepath, key_filepath, offset, length, buf, mode);
+    crypt_stats_end(CRYPT_STAT_DECRYPT_RANGE, start_ns, ret_val);
+    return ret_val;
+}
@@ -5,42 +5,40 @@
 #include <linux/slab.h>
 #include <linux/kthread.h>
 #include <linux/delay.h>
-
-// Estructura que define "un pedazo" de trabajo para un hilo.
-// Contiene punteros a los datos, la clave y dónde empezar/terminar.
-typedef struct {
-    unsigned char *buffer;        // Puntero a los datos completos del archivo en RAM
-    size_t data_size;             // Tamaño total
-    unsigned char *encryption_key;// Puntero a la clave en RAM
-    size_t key_length;            // Largo de la clave
-    size_t start_idx;             // Byte donde este hilo empieza a trabajar
-    size_t end_idx;               // Byte donde este hilo termina
-} DataFragment;
-
-// Estructura para coordinar el hilo.
-struct task_params {
-    DataFragment data_fragment;   // Los datos que el hilo va a procesar
-    struct completion completed_event; // Una "señal" para avisar cuando termine
-};
+#include <linux/random.h>
+#include <linux/timekeeping.h>
+#include "syscall_crypt.h"
+#include "syscall_crypt_trace.h"
 
 // --- EL NÚCLEO DE LA OPERACIÓN ---
 // Esta función es la que ejecuta cada hilo individualmente.
 int perform_xor_operation(void *arg) {
     struct task_params *params = (struct task_params *)arg;
     DataFragment *fragment = &params->data_fragment;
-    size_t i;
-
-    printk(KERN_INFO "Thread iniciado: start_idx=%zu, end_idx=%zu\n", fragment->start_idx, fragment->end_idx);
-
-    // Bucle principal: Recorre SOLO la sección del archivo asignada a este hilo
-    for (i = fragment->start_idx; i < fragment->end_idx; i++) {
-        // OPERACIÓN XOR (^=):
-        // Toma el byte del archivo y le aplica XOR con un byte de la clave.
-        // El operador % (módulo) hace que si la clave es corta, se repita en bucle.
-        fragment->buffer[i] ^= fragment->encryption_key[i % fragment->key_length];
+    size_t i, step;
+    // Solo se mide el tiempo si alguien está mirando el tracepoint
+    u64 start_ns = trace_crypt_fragment_enabled() ? ktime_get_ns() : 0;
+
+    // OPERACIÓN DE CIFRADO:
+    // Aplica el keystream del modo elegido (XOR con la clave repetida o ChaCha20)
+    // SOLO a la sección del archivo asignada a este hilo. file_offset + start_idx es
+    // la posición real del primer byte, así cada hilo arranca en su parte del keystream.
+    // Se avanza de a CRYPT_PROGRESS_STEP bytes para publicar el progreso y
+    // dejar de trabajar pronto si cancelaron el trabajo. El checksum se calcula
+    // sobre el bloque ya cifrado, mientras todavía está en la caché.
+    for (i = fragment->start_idx; i < fragment->end_idx; i += step) {
+        if (crypt_job_cancelled(fragment->job))
+            break;
+        step = min_t(size_t, fragment->end_idx - i, CRYPT_PROGRESS_STEP);
+        crypt_apply_keystream(fragment->cipher, fragment->buffer + i, step, fragment->file_offset + i);
+        if (fragment->checksum)
+            fragment->crc = crypt_crc_update(fragment->crc, fragment->buffer + i, step);
+        crypt_job_add_progress(fragment->job, step);
     }
 
-    printk(KERN_INFO "Thread finalizado: start_idx=%zu, end_idx=%zu\n", fragment->start_idx, fragment->end_idx);
+    if (start_ns && trace_crypt_fragment_enabled())
+        trace_crypt_fragment(false, fragment->file_offset + fragment->start_idx,
+                             fragment->end_idx - fragment->start_idx, ktime_get_ns() - start_ns);
     
     // Avisa al hilo principal que este trabajador ha terminado
     complete(&params->completed_event);
@@ -48,33 +46,37 @@ int perform_xor_operation(void *arg) {
 }
 
 // Función principal que prepara todo antes de lanzar los hilos
-int handle_file_encryption(const char *input_filepath, const char *output_filepath, const char *key_filepath, int thread_count) {
+// Si 'checksum' no es NULL deja ahí el CRC32C del archivo cifrado (cabecera, índice y datos).
+long handle_file_encryption(const char *input_filepath, const char *output_filepath, const char *key_filepath, int thread_count, int mode, u32 *checksum) {
     struct file *input_file, *output_file, *key_file; // Punteros a los archivos en el kernel
     loff_t in_offset = 0, out_offset = 0, key_offset = 0; // Posición de lectura/escritura (cursor)
-    unsigned char *encryption_key, *file_buffer; // Buffers para guardar datos en RAM
+    unsigned char *encryption_key = NULL; // Buffer para guardar la clave en RAM
+    struct crypt_cipher cipher;           // Modo de cifrado + clave preparada
+    u8 nonce[CRYPT_NONCE_SIZE];
+    struct crypt_stream stream;            // Archivos y posiciones para el pipeline
     size_t file_size, key_length;
-    
-    // Arrays para gestionar los múltiples hilos
-    struct task_params *task_list; 
-    struct task_struct **thread_list;
-    DataFragment *fragment_list;
-    
-    size_t fragment_size, extra_bytes;
-    int i, ret_val = 0;
+    struct crypt_job job;                  // Progreso visible con crypt_job_ctl
+    bool output_created;                   // La salida no existía antes de esta llamada
+    u32 header_crc = CRYPT_CRC_SEED;       // CRC de la cabecera, el checksum sigue con el índice y los datos
+    unsigned int flags = mode & CRYPT_FLAGS_MASK; // CRYPT_FLAG_* que vienen junto al modo
+    long ret_val = 0;
+
+    mode &= CRYPT_MODE_MASK;
 
-    printk(KERN_INFO "Intentando abrir los archivos\n");
+    crypt_job_init(&job);
 
     // 1. ABRIR ARCHIVOS
     // filp_open es como fopen pero en espacio de kernel.
     input_file = filp_open(input_filepath, O_RDONLY, 0);
-    // Para salida usamos O_CREAT (crear si no existe) y O_TRUNC (borrar contenido previo)
-    output_file = filp_open(output_filepath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    // Para salida usamos O_CREAT (crear si no existe) y O_TRUNC (borrar contenido previo).
+    // 'output_created' dice si se puede borrar al cancelar (no era un archivo del usuario).
+    output_file = crypt_open_output(output_filepath, &output_created);
     key_file = filp_open(key_filepath, O_RDONLY, 0);
 
     // Verificación de errores al abrir archivos (IS_ERR verifica punteros inválidos)
     if (IS_ERR(input_file)) {
         ret_val = PTR_ERR(input_file);
-        printk(KERN_ERR "Error al abrir el archivo de entrada: %d\n", ret_val);
+        printk(KERN_ERR "Error al abrir el archivo de entrada: %ld\n", ret_val);
         goto exit; // Salto al final para limpiar
     }
     // ... (chequeos similares para output y key_file omitidos por brevedad, son iguales) ...
@@ -96,8 +98,8 @@ int handle_file_encryption(const char *input_filepath, const char *output_filepa
         goto close_key_file;
     }
 
-    // kmalloc: Reservamos memoria RAM del kernel para guardar la clave
-    encryption_key = kmalloc(key_length, GFP_KERNEL);
+    // Reservamos memoria para guardar la clave (del pool: se reusa entre llamadas)
+    encryption_key = crypt_pool_alloc(key_length, NUMA_NO_NODE);
     if (!encryption_key) {
         ret_val = -ENOMEM; // Error: No hay memoria RAM suficiente
         goto close_key_file;
@@ -107,89 +109,71 @@ int handle_file_encryption(const char *input_filepath, const char *output_filepa
     ret_val = kernel_read(key_file, encryption_key, key_length, &key_offset);
     if (ret_val < 0) goto free_encryption_key;
 
-    // 3. LEER EL ARCHIVO DE ENTRADA (DATOS A CIFRAR)
+    // Preparamos el cifrado. ChaCha20 usa un nonce aleatorio nuevo por archivo.
+    get_random_bytes(nonce, sizeof(nonce));
+    ret_val = crypt_cipher_init(&cipher, mode, encryption_key, key_length, nonce);
+    if (ret_val < 0) goto free_encryption_key;
+
+    // 3. TAMAÑO DEL ARCHIVO DE ENTRADA (DATOS A CIFRAR)
     file_size = i_size_read(file_inode(input_file));
     if (file_size <= 0) {
         ret_val = -EINVAL;
         goto free_encryption_key;
     }
-
-    // Reservamos RAM para TODO el archivo de entrada
-    file_buffer = kmalloc(file_size, GFP_KERNEL);
-    if (!file_buffer) {
-        ret_val = -ENOMEM;
+    // El contador de bloque de ChaCha20 no alcanza para archivos más grandes
+    if (mode == CRYPT_MODE_CHACHA20 && file_size > CRYPT_CHACHA_MAX_BYTES) {
+        ret_val = -EFBIG;
         goto free_encryption_key;
     }
 
-    // Leemos todo el archivo a la memoria RAM (file_buffer)
-    ret_val = kernel_read(input_file, file_buffer, file_size, &in_offset);
-    if (ret_val < 0) goto free_file_buffer;
-
-    // 4. PREPARAR HILOS (MULTITHREADING)
-    // Asignamos memoria para las listas de control de hilos
-    thread_list = kmalloc(sizeof(struct task_struct *) * thread_count, GFP_KERNEL);
-    task_list = kmalloc(sizeof(struct task_params) * thread_count, GFP_KERNEL);
-    fragment_list = kmalloc(sizeof(DataFragment) * thread_count, GFP_KERNEL);
-
-    if (!thread_list || !task_list || !fragment_list) {
-        ret_val = -ENOMEM;
-        goto free_file_buffer;
+    // thread_count == 0: el kernel elige según el tamaño, las CPUs y la carga actual
+    thread_count = crypt_resolve_threads(thread_count, file_size);
+    if (thread_count < 0) {
+        ret_val = thread_count;
+        goto free_encryption_key;
     }
 
-    // Calculamos cuánto trabajo le toca a cada hilo
-    fragment_size = file_size / thread_count;
-    extra_bytes = file_size % thread_count; // Lo que sobra si la división no es exacta
-
-    // Bucle para crear y lanzar cada hilo
-    for (i = 0; i < thread_count; i++) {
-        // Configuramos los datos que este hilo específico va a usar
-        fragment_list[i].buffer = file_buffer; // Todos apuntan al mismo buffer gigante
-        fragment_list[i].data_size = file_size;
-        fragment_list[i].encryption_key = encryption_key;
-        fragment_list[i].key_length = key_length;
-        
-        // Calculamos dónde empieza y termina este hilo
-        fragment_list[i].start_idx = i * fragment_size;
-        // El último hilo se lleva los bytes extra que sobraron
-        fragment_list[i].end_idx = (i == thread_count - 1) ? (i + 1) * fragment_size + extra_bytes : (i + 1) * fragment_size;
-
-        task_list[i].data_fragment = fragment_list[i];
-        init_completion(&task_list[i].completed_event); // Inicializamos el semáforo/aviso
-
-        // kthread_run crea y arranca el hilo inmediatamente ejecutando 'perform_xor_operation'
-        thread_list[i] = kthread_run(perform_xor_operation, &task_list[i], "xor_thread_%d", i);
-        if (IS_ERR(thread_list[i])) {
-            
-            ret_val = PTR_ERR(thread_list[i]);
-            goto free_all_resources;
-        }
-    }
+    // Desde aquí el trabajo es visible (y cancelable) con crypt_job_ctl
+    crypt_job_begin(&job, file_size);
 
-    // 5. ESPERAR A LOS HILOS (SINCRONIZACIÓN)
-    // El hilo principal se detiene aquí hasta que todos los trabajadores terminen
-    for (i = 0; i < thread_count; i++) {
-        wait_for_completion(&task_list[i].completed_event);
+    // 4. GUARDAR LA CABECERA
+    // Los modos con cabecera (ChaCha20) guardan primero el nonce al inicio del archivo.
+    // Los archivos comprimidos siempre llevan cabecera, que es la que marca el formato.
+    if (crypt_mode_has_header(mode) || (flags & CRYPT_FLAG_LZ4)) {
+        ret_val = crypt_header_write(output_file, &cipher, file_size,
+                                     (flags & CRYPT_FLAG_LZ4) ? CRYPT_HEADER_LZ4 : 0, &out_offset, &header_crc);
+        if (ret_val < 0) goto free_encryption_key;
     }
 
-    // 6. GUARDAR RESULTADO
-    // Una vez que todos los hilos modificaron 'file_buffer', lo escribimos al disco
-    ret_val = kernel_write(output_file, file_buffer, file_size, &out_offset);
+    // 5. LEER, CIFRAR Y ESCRIBIR SOLAPADOS
+    // El archivo pasa por un anillo de buffers: mientras un pedazo se lee, otro se
+    // cifra en los hilos y otro se escribe (ver syscall_crypt_pipeline.c).
+    // Con CRYPT_FLAG_LZ4 los mismos hilos comprimen cada bloque antes de cifrarlo.
+    stream.input = input_file;
+    stream.in_offset = in_offset;
+    stream.output = output_file;
+    stream.out_offset = out_offset;
+    stream.data_size = file_size;
+    stream.flags = flags;
+    stream.decrypt = false;
+    stream.checksum = checksum;
+    stream.header_crc = header_crc;
+    ret_val = crypt_pipeline_run(&stream, perform_xor_operation, "xor_thread_%d", &cipher, thread_count, &job);
     if (ret_val < 0) {
-        printk(KERN_ERR "Error al escribir en salida: %d\n", ret_val);
+        printk(KERN_ERR "Error al cifrar el archivo: %ld\n", ret_val);
+        // Un trabajo cancelado no deja un archivo de salida a medio escribir
+        if (ret_val == -ECANCELED || ret_val == -EINTR)
+            crypt_remove_output(output_file, output_created);
     }
 
-// 7. LIMPIEZA DE MEMORIA (GARBAGE COLLECTION MANUAL)
-// En C y Kernel, debes liberar todo lo que reservaste con kmalloc
-    free_all_resources:
-        kfree(thread_list);
-        kfree(task_list);
-        kfree(fragment_list);
-
-    free_file_buffer:
-        kfree(file_buffer);
-
+// 6. LIMPIEZA DE MEMORIA (GARBAGE COLLECTION MANUAL)
+// En C y Kernel, debes liberar todo lo que reservaste
     free_encryption_key:
-        kfree(encryption_key);
+        crypt_job_end(&job);
+        memzero_explicit(&cipher, sizeof(cipher));
+        // La clave no puede quedar en un buffer que después usa otra llamada
+        memzero_explicit(encryption_key, key_length);
+        crypt_pool_free(encryption_key, key_length);
 
     close_key_file:
         filp_close(key_file, NULL);
@@ -204,10 +188,17 @@ int handle_file_encryption(const char *input_filepath, const char *output_filepa
         return ret_val;
 }
 
-// Definición de la System Call (lo que llama el usuario)
-SYSCALL_DEFINE4(my_encrypt, const char __user *, input_filepath, const char __user *, output_filepath, const char __user *, key_filepath, int, thread_count) {
+static long do_my_encrypt(const char __user *input_filepath, const char __user *output_filepath, const char __user *key_filepath, int thread_count, int mode, u32 __user *checksum) {
     char *k_input_filepath, *k_output_filepath, *k_key_filepath;
-    int ret_val;
+    u32 k_checksum = 0;
+    long ret_val;
+
+    // Modo de cifrado: CRYPT_MODE_XOR (original) o CRYPT_MODE_CHACHA20,
+    // opcionalmente combinado con CRYPT_FLAG_DIRECT / CRYPT_FLAG_DIRECT_INPUT / CRYPT_FLAG_LZ4
+    if ((mode & ~(CRYPT_MODE_MASK | CRYPT_FLAGS_MASK)) || (mode & CRYPT_FLAG_VERIFY))
+        return -EINVAL;
+    if (checksum && !IS_REACHABLE(CONFIG_CRC32))
+        return -EOPNOTSUPP;
 
     // COPIAR DATOS DE USUARIO A KERNEL
     // strndup_user copia las cadenas de texto (rutas) de forma segura.
@@ -223,13 +214,29 @@ SYSCALL_DEFINE4(my_encrypt, const char __user *, input_filepath, const char __us
     }
 
     // Llamar a la función lógica definida arriba
-    ret_val = handle_file_encryption(k_input_filepath, k_output_filepath, k_key_filepath, thread_count);
+    ret_val = handle_file_encryption(k_input_filepath, k_output_filepath, k_key_filepath, thread_count, mode,
+                                     checksum ? &k_checksum : NULL);
+    if (ret_val >= 0 && checksum && put_user(k_checksum, checksum))
+        ret_val = -EFAULT;
 
 free_memory:
    
-    kfree(k_input_filepath);
-    kfree(k_output_filepath);
-    kfree(k_key_filepath);
+    // strndup_user puede devolver un puntero de error: solo liberamos los válidos
+    if (!IS_ERR(k_input_filepath)) kfree(k_input_filepath);
+    if (!IS_ERR(k_output_filepath)) kfree(k_output_filepath);
+    if (!IS_ERR(k_key_filepath)) kfree(k_key_filepath);
 
     return ret_val;
-}
\ No newline at end of file
+}
+
+// Definición de la System Call (lo que llama el usuario)
+// 'checksum' (opcional, puede ser NULL): recibe el CRC32C del archivo cifrado entero,
+// el mismo que my_decrypt puede verificar con CRYPT_FLAG_VERIFY.
+SYSCALL_DEFINE6(my_encrypt, const char __user *, input_filepath, const char __user *, output_filepath, const char __user *, key_filepath, int, thread_count, int, mode, u32 __user *, checksum) {
+    u64 start_ns = crypt_stats_begin(CRYPT_STAT_ENCRYPT);
+    long ret_val;
+
+    ret_val = do_my_encrypt(input_filepath, output_filepath, key_filepath, thread_count, mode, checksum);
+    crypt_stats_end(CRYPT_STAT_ENCRYPT, start_ns, ret_val);
+    return ret_val;
+}
@@ -2,6 +2,9 @@
 #include <linux/syscalls.h>
 #include <linux/uaccess.h> // Necesario para put_user()
 #include <linux/tty.h>      // Incluye la declaración para do_syslog
+#include <linux/kmsg_dump.h> // kmsg_dump_get_line: lectura del log mensaje por mensaje
+#include <linux/slab.h>
+#include <linux/ctype.h>
 
 /*
  * Declaración Externa:
@@ -18,14 +21,164 @@ extern int do_syslog(int type, char __user *buf, int len);
  * El tipo 3 de la función syslog lee el buffer de logs sin borrar su contenido.
  */
 #define SYSLOG_ACTION_READ 3
+/*
+ * El tipo 10 solo devuelve el tamaño del buffer, pero pasa por los mismos permisos
+ * que leer el log (security_syslog y, con dmesg_restrict, CAP_SYSLOG).
+ */
+#define SYSLOG_ACTION_SIZE_BUFFER 10
+
+/*
+ * Modos de kernel_logs:
+ * - KERNEL_LOGS_TEXT: el texto de syslog tal cual (comportamiento original).
+ * - KERNEL_LOGS_RECORDS: un arreglo de struct kernel_log_record al inicio de 'buf'
+ *   y el texto de cada mensaje (sin prefijos ni '\n') guardado desde el final de
+ *   'buf' hacia atrás. Quien lee no tiene que parsear "<6>[   12.345678] ...".
+ *   En actual_len_out se devuelve la cantidad de registros.
+ */
+#define KERNEL_LOGS_TEXT    0
+#define KERNEL_LOGS_RECORDS 1
+
+struct kernel_log_record {
+    __u64 seq;                    // Número de secuencia del mensaje en el log del kernel
+    __u64 ts_nsec;                // Desde el arranque (resolución de microsegundos, como dmesg)
+    __u8 level;                   // 0 = KERN_EMERG ... 7 = KERN_DEBUG
+    __u8 facility;                // 0 = kernel; otras para lo escrito en /dev/kmsg
+    __u16 text_len;
+    __u32 text_offset;            // Dónde está el texto, desde el inicio de 'buf'
+};
+static_assert(sizeof(struct kernel_log_record) == 24);
+
+// Un mensaje con su prefijo; kmsg_dump_get_line corta los más largos
+#define KERNEL_LOG_LINE_MAX 1024
+
+/*
+ * Helper: kernel_log_parse
+ * Separa el prefijo "<prioridad>[segundos.microsegundos] " que agrega
+ * kmsg_dump_get_line y llena level/facility/ts_nsec. Retorna dónde empieza el
+ * texto y deja en *text_len su largo sin el '\n' final.
+ */
+static size_t kernel_log_parse(const char *line, size_t len, struct kernel_log_record *rec, size_t *text_len)
+{
+    unsigned int prio = 0;
+    u64 sec = 0, usec = 0;
+    size_t i = 0, start;
+
+    if (i < len && line[i] == '<') {
+        for (i++; i < len && isdigit(line[i]); i++)
+            prio = prio * 10 + (line[i] - '0');
+        if (i < len && line[i] == '>')
+            i++;
+    }
+    rec->level = prio & 7;
+    rec->facility = prio >> 3;
+    rec->ts_nsec = 0;
+
+    // La marca de tiempo solo está si printk.time está activo
+    start = i;
+    if (i < len && line[i] == '[') {
+        for (i++; i < len && line[i] == ' '; i++)
+            ;
+        for (; i < len && isdigit(line[i]); i++)
+            sec = sec * 10 + (line[i] - '0');
+        if (i < len && line[i] == '.') {
+            for (i++; i < len && isdigit(line[i]); i++)
+                usec = usec * 10 + (line[i] - '0');
+        }
+        if (i < len && line[i] == ']') {
+            rec->ts_nsec = sec * NSEC_PER_SEC + usec * NSEC_PER_USEC;
+            i++;
+            if (i < len && line[i] == ' ')
+                i++;
+        } else {
+            i = start; // No era una marca de tiempo: es parte del texto
+        }
+    }
+
+    *text_len = len - i;
+    if (*text_len && line[len - 1] == '\n')
+        (*text_len)--;
+    return i;
+}
 
 /*
- * SYSCALL_DEFINE3: Macro para definir la llamada al sistema.
+ * Helper: kernel_logs_records
+ * Llena 'buf' con los mensajes más nuevos que entren (modo KERNEL_LOGS_RECORDS).
+ * Primero mide cuánto ocupa todo el log y después lo recorre de nuevo saltando
+ * los mensajes más viejos hasta que el resto entre en 'len' bytes.
+ * kmsg_dump_get_line no revisa permisos: se piden a do_syslog antes de leer, así
+ * este modo no le muestra el log a quien dmesg no se lo mostraría.
+ */
+static long kernel_logs_records(char __user *buf, size_t len, int __user *count_out)
+{
+    struct kmsg_dump_iter iter;
+    struct kernel_log_record rec;
+    size_t line_len, text_start, text_len, head = 0, tail = len;
+    u64 total = 0;
+    int count = 0;
+    char *line;
+    long ret_val = 0;
+
+    ret_val = do_syslog(SYSLOG_ACTION_SIZE_BUFFER, NULL, 0);
+    if (ret_val < 0)
+        return ret_val;
+    ret_val = 0;
+
+    if (len > INT_MAX)
+        len = tail = INT_MAX; // text_offset es de 32 bits
+
+    line = kmalloc(KERNEL_LOG_LINE_MAX, GFP_KERNEL);
+    if (!line)
+        return -ENOMEM;
+
+    // 1. Cuánto ocupa el log completo como registros
+    kmsg_dump_rewind(&iter);
+    while (kmsg_dump_get_line(&iter, true, line, KERNEL_LOG_LINE_MAX, &line_len)) {
+        kernel_log_parse(line, line_len, &rec, &text_len);
+        total += sizeof(rec) + text_len;
+    }
+
+    // 2. Saltar los más viejos que no entran y copiar el resto
+    kmsg_dump_rewind(&iter);
+    while (kmsg_dump_get_line(&iter, true, line, KERNEL_LOG_LINE_MAX, &line_len)) {
+        text_start = kernel_log_parse(line, line_len, &rec, &text_len);
+        if (total > len) {
+            total -= min_t(u64, total, sizeof(rec) + text_len);
+            continue;
+        }
+        // Puede haber llegado algún mensaje entre las dos pasadas
+        if (head + sizeof(rec) + text_len > tail)
+            break;
+
+        tail -= text_len;
+        rec.seq = iter.cur_seq - 1; // kmsg_dump_get_line ya avanzó al siguiente
+        rec.text_len = text_len;
+        rec.text_offset = tail;
+        if (copy_to_user(buf + tail, line + text_start, text_len) ||
+            copy_to_user(buf + head, &rec, sizeof(rec))) {
+            ret_val = -EFAULT;
+            goto free_line;
+        }
+        head += sizeof(rec);
+        count++;
+    }
+
+    if (put_user(count, count_out))
+        ret_val = -EFAULT;
+
+free_line:
+    kfree(line);
+    return ret_val;
+}
+
+/*
+ * SYSCALL_DEFINE4: Macro para definir la llamada al sistema.
  * - Nombre: get_kernel_logs
  * - Argumentos:
  * 1. char __user *buf: Puntero al buffer de usuario donde se copiarán los logs.
  * 2. size_t len: Tamaño máximo del buffer de usuario.
- * 3. int __user *actual_len_out: Puntero donde se escribirá la longitud real de los datos copiados.
+ * 3. int __user *actual_len_out: Puntero donde se escribirá la longitud real de los datos copiados
+ *    (en modo KERNEL_LOGS_RECORDS, la cantidad de registros).
+ * 4. int mode: KERNEL_LOGS_TEXT o KERNEL_LOGS_RECORDS.
  *
  * NOTA IMPORTANTE sobre "los últimos 5 logs":
  * La implementación estándar del kernel (do_syslog) devuelve el contenido del
@@ -34,7 +187,7 @@ extern int do_syslog(int type, char __user *buf, int len);
  * formato de cada entrada de log, lo cual hace que la syscall sea innecesariamente
  * compleja. Por lo tanto, esta syscall devuelve el contenido del buffer completo.
  */
-SYSCALL_DEFINE3(kernel_logs, char __user *, buf, size_t, len, int __user *, actual_len_out)
+SYSCALL_DEFINE4(kernel_logs, char __user *, buf, size_t, len, int __user *, actual_len_out, int, mode)
 {
     long bytes_read;
 
@@ -48,6 +201,11 @@ SYSCALL_DEFINE3(kernel_logs, char __user *, buf, size_t, len, int __user *, actu
     if (!actual_len_out)
         return -EINVAL; // Error de argumento inválido
 
+    if (mode == KERNEL_LOGS_RECORDS)
+        return kernel_logs_records(buf, len, actual_len_out);
+    if (mode != KERNEL_LOGS_TEXT)
+        return -EINVAL;
+
     // 2. Ejecutar la acción de lectura del log del kernel.
     // Llama a la función interna del kernel para leer los logs (SYSLOG_ACTION_READ = 3).
     bytes_read = do_syslog(SYSLOG_ACTION_READ, buf, len);
@@ -0,0 +1,363 @@
+// kernel/syscall_pressure.c
+// Avisos de presión de CPU/RAM: en vez de consultar cpu_usage/ram_usage cada segundo
+// para ver si se pasó un umbral, el proceso abre un fd con sus umbrales y el kernel
+// lo despierta solo cuando se cruzan. El fd se usa con read() y poll()/epoll.
+#include <linux/kernel.h>
+#include <linux/syscalls.h>
+#include <linux/uaccess.h>
+#include <linux/anon_inodes.h>
+#include <linux/fs.h>
+#include <linux/file.h>
+#include <linux/poll.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/wait.h>
+#include <linux/workqueue.h>
+#include <linux/kfifo.h>
+#include <linux/timekeeping.h>
+#include <linux/psi.h>
+#include <linux/hashtable.h>
+#include <linux/cred.h>
+#include <linux/capability.h>
+#include <linux/sched/loadavg.h>
+#include "syscall_cpu_usage.h"
+#include "syscall_ram_usage.h"
+
+// Qué se mide (todos los valores van de 0 a 10000, como cpu_usage / ram_usage)
+#define PRESSURE_CPU     0 // Uso de CPU (cpu_usage)
+#define PRESSURE_RAM     1 // Uso de RAM (ram_usage)
+#define PRESSURE_PSI_CPU 2 // PSI: % del tiempo con tareas esperando CPU (some avg10)
+#define PRESSURE_PSI_MEM 3 // PSI: % del tiempo con tareas esperando memoria (some avg10)
+
+// Un umbral con histéresis: se avisa al llegar a 'high' y, después, al bajar a 'low'.
+// Así un valor que oscila alrededor del umbral no genera un aviso por muestra.
+struct pressure_threshold {
+    __u32 resource;               // PRESSURE_*
+    __u32 high_x100;
+    __u32 low_x100;               // Menor que high_x100
+    __u32 reserved;               // 0
+};
+
+// Lo que devuelve read() por cada cruce
+struct pressure_event {
+    __u64 ts_nsec;                // CLOCK_REALTIME del momento en que se detectó
+    __u32 index;                  // Posición del umbral en el arreglo registrado
+    __u32 resource;               // PRESSURE_*
+    __u32 above;                  // 1 = pasó high_x100, 0 = volvió a low_x100
+    __u32 value_x100;             // Valor medido
+};
+static_assert(sizeof(struct pressure_event) == 24);
+
+#define PRESSURE_MAX_THRESHOLDS 16
+#define PRESSURE_INTERVAL_DEFAULT_MS 1000
+#define PRESSURE_INTERVAL_MIN_MS     100 // Igual que el intervalo de muestreo de cpu_usage
+#define PRESSURE_INTERVAL_MAX_MS     60000
+// Cada fd es un trabajo que corre cada 'interval': sin CAP_SYS_RESOURCE se limita
+// cuántos tiene abiertos cada usuario y qué tan seguido pueden medir
+#define PRESSURE_INTERVAL_UNPRIV_MIN_MS 1000
+#define PRESSURE_MAX_WATCHES_PER_USER   8
+#define PRESSURE_QUEUE_LEN 64     // Avisos sin leer; si se llena se descarta el más viejo
+
+// fds abiertos por cada usuario (euid)
+struct pressure_user {
+    struct hlist_node node;
+    kuid_t uid;
+    unsigned int watches;
+};
+static DEFINE_HASHTABLE(pressure_users, 5);
+static DEFINE_SPINLOCK(pressure_users_lock);
+
+struct pressure_watch {
+    struct pressure_user *user;   // A quién se le cuenta este fd
+    struct pressure_threshold thresholds[PRESSURE_MAX_THRESHOLDS];
+    bool above[PRESSURE_MAX_THRESHOLDS];
+    unsigned int count;
+    unsigned long interval;       // En jiffies
+    struct delayed_work work;     // Muestreo periódico en el workqueue del sistema
+    spinlock_t lock;              // Protege 'events'
+    DECLARE_KFIFO(events, struct pressure_event, PRESSURE_QUEUE_LEN);
+    wait_queue_head_t wait;       // read() y poll() esperan acá
+};
+
+/*
+ * pressure_user_get
+ * Cuenta un fd más para el usuario que llama. Pasado PRESSURE_MAX_WATCHES_PER_USER
+ * hace falta CAP_SYS_RESOURCE (capable() puede dormir: se llama sin el spinlock y
+ * después se busca al usuario de nuevo). Retorna la cuenta o ERR_PTR(-EMFILE/-ENOMEM).
+ */
+static struct pressure_user *pressure_user_get(void)
+{
+    kuid_t uid = current_euid();
+    struct pressure_user *user, *new;
+    bool privileged = false;
+
+    // Se reserva antes del spinlock; si el usuario ya tiene cuenta se libera
+    new = kzalloc(sizeof(*new), GFP_KERNEL);
+    if (!new)
+        return ERR_PTR(-ENOMEM);
+
+again:
+    spin_lock(&pressure_users_lock);
+    hash_for_each_possible(pressure_users, user, node, __kuid_val(uid)) {
+        if (uid_eq(user->uid, uid))
+            goto found;
+    }
+    user = new;
+    new = NULL;
+    user->uid = uid;
+    hash_add(pressure_users, &user->node, __kuid_val(uid));
+found:
+    if (user->watches >= PRESSURE_MAX_WATCHES_PER_USER && !privileged) {
+        spin_unlock(&pressure_users_lock);
+        if (!capable(CAP_SYS_RESOURCE)) {
+            kfree(new);
+            return ERR_PTR(-EMFILE);
+        }
+        privileged = true;
+        goto again;
+    }
+    user->watches++;
+    spin_unlock(&pressure_users_lock);
+    kfree(new);
+    return user;
+}
+
+static void pressure_user_put(struct pressure_user *user)
+{
+    spin_lock(&pressure_users_lock);
+    if (--user->watches == 0)
+        hash_del(&user->node);
+    else
+        user = NULL;
+    spin_unlock(&pressure_users_lock);
+    kfree(user);
+}
+
+// PSI guarda el porcentaje en punto fijo (LOAD_INT da la parte entera)
+static u32 pressure_psi_x100(int state)
+{
+#ifdef CONFIG_PSI
+    return (u32)((READ_ONCE(psi_system.avg[state][0]) * 100) >> FSHIFT);
+#else
+    return 0;
+#endif
+}
+
+static u32 pressure_read(u32 resource)
+{
+    switch (resource) {
+    case PRESSURE_CPU:
+        return cpu_usage_sample_x100(); // Con intervalos de más de 1s duerme 100ms
+    case PRESSURE_RAM:
+        return ram_usage_x100();
+#ifdef CONFIG_PSI
+    case PRESSURE_PSI_CPU:
+        return pressure_psi_x100(PSI_CPU_SOME);
+    case PRESSURE_PSI_MEM:
+        return pressure_psi_x100(PSI_MEM_SOME);
+#endif
+    default:
+        return 0;
+    }
+}
+
+static void pressure_push(struct pressure_watch *watch, const struct pressure_event *event)
+{
+    spin_lock(&watch->lock);
+    if (kfifo_is_full(&watch->events))
+        kfifo_skip(&watch->events);
+    kfifo_put(&watch->events, *event);
+    spin_unlock(&watch->lock);
+    wake_up_interruptible_poll(&watch->wait, EPOLLIN | EPOLLRDNORM);
+}
+
+/*
+ * pressure_sample
+ * Corre cada 'interval': mide cada recurso una vez y encola un aviso por cada
+ * umbral que cambió de lado. Va en system_long_wq porque medir la CPU puede dormir.
+ */
+static void pressure_sample(struct work_struct *work)
+{
+    struct pressure_watch *watch = container_of(to_delayed_work(work), struct pressure_watch, work);
+    u32 values[PRESSURE_PSI_MEM + 1];
+    bool measured[PRESSURE_PSI_MEM + 1] = { false };
+    struct pressure_threshold *t;
+    struct pressure_event event;
+    unsigned int i;
+
+    for (i = 0; i < watch->count; i++) {
+        t = &watch->thresholds[i];
+        if (!measured[t->resource]) {
+            values[t->resource] = pressure_read(t->resource);
+            measured[t->resource] = true;
+        }
+        // Sin un valor medido no se cruzó nada (tampoco se vuelve de un cruce)
+        if (values[t->resource] == CPU_USAGE_UNKNOWN)
+            continue;
+
+        if (!watch->above[i] && values[t->resource] >= t->high_x100)
+            watch->above[i] = true;
+        else if (watch->above[i] && values[t->resource] <= t->low_x100)
+            watch->above[i] = false;
+        else
+            continue;
+
+        event.ts_nsec = ktime_get_real_ns();
+        event.index = i;
+        event.resource = t->resource;
+        event.above = watch->above[i];
+        event.value_x100 = values[t->resource];
+        pressure_push(watch, &event);
+    }
+
+    queue_delayed_work(system_long_wq, &watch->work, watch->interval);
+}
+
+static ssize_t pressure_fd_read(struct file *file, char __user *buf, size_t count, loff_t *ppos)
+{
+    struct pressure_watch *watch = file->private_data;
+    struct pressure_event event;
+    ssize_t copied = 0;
+    int ret;
+
+    if (count < sizeof(event))
+        return -EINVAL;
+
+    // Bloquea hasta el primer aviso (salvo O_NONBLOCK) y después entrega los que haya
+    for (;;) {
+        spin_lock(&watch->lock);
+        ret = kfifo_get(&watch->events, &event);
+        spin_unlock(&watch->lock);
+        if (ret)
+            break;
+        if (file->f_flags & O_NONBLOCK)
+            return -EAGAIN;
+        ret = wait_event_interruptible(watch->wait, !kfifo_is_empty(&watch->events));
+        if (ret)
+            return ret;
+    }
+
+    do {
+        if (copy_to_user(buf + copied, &event, sizeof(event)))
+            return copied ? copied : -EFAULT;
+        copied += sizeof(event);
+        if (count - copied < sizeof(event))
+            break;
+        spin_lock(&watch->lock);
+        ret = kfifo_get(&watch->events, &event);
+        spin_unlock(&watch->lock);
+    } while (ret);
+
+    return copied;
+}
+
+static __poll_t pressure_fd_poll(struct file *file, poll_table *wait)
+{
+    struct pressure_watch *watch = file->private_data;
+
+    poll_wait(file, &watch->wait, wait);
+    return kfifo_is_empty(&watch->events) ? 0 : EPOLLIN | EPOLLRDNORM;
+}
+
+static int pressure_fd_release(struct inode *inode, struct file *file)
+{
+    struct pressure_watch *watch = file->private_data;
+
+    cancel_delayed_work_sync(&watch->work);
+    pressure_user_put(watch->user);
+    kfree(watch);
+    return 0;
+}
+
+static const struct file_operations pressure_fops = {
+    .owner = THIS_MODULE,
+    .read = pressure_fd_read,
+    .poll = pressure_fd_poll,
+    .release = pressure_fd_release,
+    .llseek = noop_llseek,
+};
+
+/*
+ * SYSCALL_DEFINE4: stats_pressure_open
+ * - thresholds: arreglo de 'count' struct pressure_threshold (1 a PRESSURE_MAX_THRESHOLDS)
+ * - interval_ms: cada cuánto se mide (0 = 1000ms; entre 100ms y 60s). Menos de 1s
+ *   necesita CAP_SYS_RESOURCE (-EPERM).
+ * - flags: O_CLOEXEC y/o O_NONBLOCK para el fd
+ * Retorna un fd: read() entrega struct pressure_event y poll() avisa cuando hay alguno.
+ * El muestreo se detiene al cerrar el fd. Cada usuario puede tener abiertos hasta
+ * PRESSURE_MAX_WATCHES_PER_USER; más que eso necesita CAP_SYS_RESOURCE (-EMFILE).
+ */
+SYSCALL_DEFINE4(stats_pressure_open, const struct pressure_threshold __user *, thresholds,
+                unsigned int, count, unsigned int, interval_ms, unsigned int, flags) {
+    struct pressure_watch *watch;
+    unsigned int i;
+    int fd;
+
+    // 1. VALIDACIONES
+    if (!thresholds || count == 0 || count > PRESSURE_MAX_THRESHOLDS)
+        return -EINVAL;
+    if (flags & ~(O_CLOEXEC | O_NONBLOCK))
+        return -EINVAL;
+    if (interval_ms == 0)
+        interval_ms = PRESSURE_INTERVAL_DEFAULT_MS;
+    if (interval_ms < PRESSURE_INTERVAL_MIN_MS || interval_ms > PRESSURE_INTERVAL_MAX_MS)
+        return -EINVAL;
+    if (interval_ms < PRESSURE_INTERVAL_UNPRIV_MIN_MS && !capable(CAP_SYS_RESOURCE))
+        return -EPERM;
+
+    watch = kzalloc(sizeof(*watch), GFP_KERNEL);
+    if (!watch)
+        return -ENOMEM;
+
+    // 2. COPIAR Y REVISAR LOS UMBRALES
+    if (copy_from_user(watch->thresholds, thresholds, count * sizeof(*thresholds))) {
+        fd = -EFAULT;
+        goto free_watch;
+    }
+    for (i = 0; i < count; i++) {
+        struct pressure_threshold *t = &watch->thresholds[i];
+
+        if (t->resource > PRESSURE_PSI_MEM || t->reserved ||
+            t->high_x100 > 10000 || t->low_x100 >= t->high_x100) {
+            fd = -EINVAL;
+            goto free_watch;
+        }
+        // Sin PSI (o desactivado con psi=0) esos valores nunca cambiarían
+        if (t->resource >= PRESSURE_PSI_CPU) {
+#ifdef CONFIG_PSI
+            if (static_branch_likely(&psi_disabled)) {
+                fd = -EOPNOTSUPP;
+                goto free_watch;
+            }
+#else
+            fd = -EOPNOTSUPP;
+            goto free_watch;
+#endif
+        }
+    }
+    watch->user = pressure_user_get();
+    if (IS_ERR(watch->user)) {
+        fd = PTR_ERR(watch->user);
+        goto free_watch;
+    }
+    watch->count = count;
+    watch->interval = msecs_to_jiffies(interval_ms);
+    spin_lock_init(&watch->lock);
+    INIT_KFIFO(watch->events);
+    init_waitqueue_head(&watch->wait);
+    INIT_DELAYED_WORK(&watch->work, pressure_sample);
+
+    // 3. ARRANCAR EL MUESTREO Y CREAR EL FD
+    // La primera muestra sale enseguida: si ya se está por encima de un umbral se avisa.
+    // Se programa antes de crear el fd porque otro hilo podría cerrarlo apenas exista.
+    queue_delayed_work(system_long_wq, &watch->work, 0);
+    fd = anon_inode_getfd("[stats_pressure]", &pressure_fops, watch, O_RDONLY | flags);
+    if (fd >= 0)
+        return fd; // Desde acá 'watch' se libera en pressure_fd_release
+    cancel_delayed_work_sync(&watch->work);
+    pressure_user_put(watch->user);
+
+free_watch:
+    kfree(watch);
+    return fd;
+}
@@ -0,0 +1,11 @@
+// kernel/syscall_ram_usage.h
+// Uso de RAM compartido con otras syscalls (syscall_ram_usage.c).
+#ifndef _KERNEL_SYSCALL_RAM_USAGE_H
+#define _KERNEL_SYSCALL_RAM_USAGE_H
+
+#include <linux/types.h>
+
+// Uso de RAM actual (0 a 10000), el mismo valor que devuelve ram_usage.
+u32 ram_usage_x100(void);
+
+#endif /* _KERNEL_SYSCALL_RAM_USAGE_H */
@@ -0,0 +1,275 @@
+// kernel/syscall_top_tasks.c
+// Quién está usando la CPU y la memoria: los N procesos con más tiempo de CPU desde
+// la consulta anterior y los N con más memoria residente, recorriendo la lista de
+// tareas una sola vez (en vez de leer /proc/<pid>/stat proceso por proceso).
+#include <linux/kernel.h>
+#include <linux/syscalls.h>
+#include <linux/uaccess.h>
+#include <linux/sched/signal.h>
+#include <linux/sched/cputime.h>
+#include <linux/sched/stat.h>
+#include <linux/pid_namespace.h>
+#include <linux/oom.h>
+#include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/sort.h>
+#include <linux/bsearch.h>
+#include <linux/mutex.h>
+#include <linux/delay.h>
+#include <linux/timekeeping.h>
+
+// Lo que recibe el usuario por cada proceso (40 bytes)
+struct top_task {
+    __s32 pid;                    // TGID, visto desde el namespace de PIDs de quien llama
+    __u32 cpu_x100;               // CPU usada en el intervalo, % de una CPU x100 (puede pasar de 10000)
+    __u64 cpu_ns;                 // Tiempo de CPU del proceso (todos sus hilos) en el intervalo
+    __u64 rss_bytes;              // Memoria residente
+    char comm[TASK_COMM_LEN];
+};
+static_assert(sizeof(struct top_task) == 40);
+
+#define TOP_TASKS_MAX 64
+// Si la foto anterior es más vieja que esto, se toma una nueva y se mide 100ms
+#define TOP_SNAPSHOT_MAX_AGE (5ULL * NSEC_PER_SEC)
+#define TOP_SNAPSHOT_SLACK 64     // Procesos que pueden aparecer mientras se recorre la lista
+
+// Un proceso visto durante el recorrido
+struct top_entry {
+    pid_t pid;                    // TGID global: la foto se comparte entre namespaces
+    pid_t vpid;                   // TGID en el namespace de quien llama, 0 = no lo ve
+    u64 start_time;               // Distingue un PID reutilizado
+    u64 runtime;                  // Tiempo de CPU acumulado (ns)
+    u64 delta;                    // runtime - el de la foto anterior
+    u64 rss;                      // Páginas residentes
+    char comm[TASK_COMM_LEN];
+};
+
+// Foto anterior (ordenada por PID) contra la que se calculan los deltas
+struct top_sample {
+    pid_t pid;
+    u64 start_time;
+    u64 runtime;
+};
+static DEFINE_MUTEX(top_lock);
+static struct top_sample *top_prev;
+static unsigned int top_prev_count;
+static u64 top_prev_ns;
+
+static int top_cmp_pid(const void *a, const void *b)
+{
+    pid_t pa = ((const struct top_entry *)a)->pid, pb = ((const struct top_entry *)b)->pid;
+
+    return (pa > pb) - (pa < pb);
+}
+
+static int top_cmp_sample(const void *key, const void *elt)
+{
+    pid_t pa = *(const pid_t *)key, pb = ((const struct top_sample *)elt)->pid;
+
+    return (pa > pb) - (pa < pb);
+}
+
+// Mayor primero
+static int top_cmp_cpu(const void *a, const void *b)
+{
+    u64 da = ((const struct top_entry *)a)->delta, db = ((const struct top_entry *)b)->delta;
+
+    return (da < db) - (da > db);
+}
+
+static int top_cmp_rss(const void *a, const void *b)
+{
+    u64 ra = ((const struct top_entry *)a)->rss, rb = ((const struct top_entry *)b)->rss;
+
+    return (ra < rb) - (ra > rb);
+}
+
+/*
+ * top_collect
+ * Recorre la lista de procesos una vez, bajo RCU (sin bloquear a fork/exit).
+ * El tiempo de CPU suma todos los hilos del proceso; la memoria se lee de
+ * cualquier hilo que todavía tenga mm (el líder puede haber terminado antes).
+ * Se guardan todos los procesos (la foto sirve para cualquier namespace); 'vpid'
+ * es su TGID en 'ns', o 0 si desde ahí no se ven.
+ * Retorna cuántos procesos se guardaron en 'entries' (a lo sumo 'max').
+ */
+static unsigned int top_collect(struct top_entry *entries, unsigned int max, struct pid_namespace *ns)
+{
+    struct task_struct *p, *t;
+    struct task_cputime times;
+    unsigned int count = 0;
+
+    rcu_read_lock();
+    for_each_process(p) {
+        if (count == max)
+            break;
+        entries[count].pid = task_tgid_nr(p);
+        entries[count].vpid = task_tgid_nr_ns(p, ns);
+        entries[count].start_time = p->start_time;
+        thread_group_cputime(p, &times);
+        entries[count].runtime = times.sum_exec_runtime;
+        entries[count].delta = 0;
+        entries[count].rss = 0;
+        t = find_lock_task_mm(p); // Retorna con task_lock tomado
+        if (t) {
+            entries[count].rss = get_mm_rss(t->mm);
+            task_unlock(t);
+        }
+        get_task_comm(entries[count].comm, p);
+        count++;
+    }
+    rcu_read_unlock();
+
+    sort(entries, count, sizeof(*entries), top_cmp_pid, NULL);
+    return count;
+}
+
+/*
+ * top_update
+ * Calcula el delta de CPU de cada proceso contra la foto anterior y deja la
+ * actual en su lugar. Un proceso que nació después de la foto anterior cuenta
+ * todo su tiempo. Retorna el intervalo medido en ns.
+ */
+static u64 top_update(struct top_entry *entries, unsigned int count, u64 now)
+{
+    struct top_sample *samples, *prev;
+    u64 interval = now - top_prev_ns;
+    unsigned int i;
+
+    for (i = 0; i < count; i++) {
+        prev = top_prev ? bsearch(&entries[i].pid, top_prev, top_prev_count, sizeof(*top_prev),
+                                  top_cmp_sample) : NULL;
+        if (prev && prev->start_time == entries[i].start_time)
+            entries[i].delta = entries[i].runtime > prev->runtime ? entries[i].runtime - prev->runtime : 0;
+        else if (top_prev && entries[i].start_time > top_prev_ns)
+            entries[i].delta = entries[i].runtime;
+    }
+
+    // Si no hay memoria para la foto nueva se conserva la anterior
+    samples = kvmalloc_array(max(count, 1U), sizeof(*samples), GFP_KERNEL);
+    if (samples) {
+        for (i = 0; i < count; i++) {
+            samples[i].pid = entries[i].pid;
+            samples[i].start_time = entries[i].start_time;
+            samples[i].runtime = entries[i].runtime;
+        }
+        kvfree(top_prev);
+        top_prev = samples;
+        top_prev_count = count;
+        top_prev_ns = now;
+    }
+    return interval;
+}
+
+// Deja solo los procesos visibles desde el namespace de quien llama: en un
+// contenedor no se informan (ni se cuentan) los PIDs del host
+static unsigned int top_visible(struct top_entry *entries, unsigned int count)
+{
+    unsigned int i, visible = 0;
+
+    for (i = 0; i < count; i++) {
+        if (entries[i].vpid)
+            entries[visible++] = entries[i];
+    }
+    return visible;
+}
+
+static int top_copy(struct top_task __user *out, struct top_entry *entries, unsigned int count, u64 interval)
+{
+    struct top_task task;
+    unsigned int i;
+
+    for (i = 0; i < count; i++) {
+        memset(&task, 0, sizeof(task));
+        task.pid = entries[i].vpid;
+        task.cpu_ns = entries[i].delta;
+        task.cpu_x100 = interval ? (u32)min_t(u64, div64_u64(entries[i].delta * 10000ULL, interval), U32_MAX) : 0;
+        task.rss_bytes = entries[i].rss << PAGE_SHIFT;
+        memcpy(task.comm, entries[i].comm, sizeof(task.comm));
+        if (copy_to_user(&out[i], &task, sizeof(task)))
+            return -EFAULT;
+    }
+    return 0;
+}
+
+/*
+ * SYSCALL_DEFINE4: top_tasks
+ * - by_cpu: arreglo de 'count' struct top_task, ordenado por CPU usada en el intervalo
+ * - by_rss: arreglo de 'count' struct top_task, ordenado por memoria residente
+ * - count: cuántos procesos devolver en cada arreglo (1 a TOP_TASKS_MAX)
+ * - interval_ns: (opcional) recibe el intervalo sobre el que se midió la CPU
+ * El intervalo va desde la consulta anterior de cualquier proceso, en cualquier
+ * namespace: la foto es una sola para todo el sistema. Dos programas que consultan
+ * cada 1s por separado ven intervalos más cortos (y CPU medida en ese tramo), por
+ * eso se devuelve 'interval_ns'. Si no hubo una consulta en los últimos 5 segundos
+ * se mide durante 100ms, como cpu_usage.
+ * Solo se informan los procesos visibles desde el namespace de PIDs de quien llama,
+ * con su PID en ese namespace.
+ * Retorna la cantidad de procesos escritos en cada arreglo.
+ */
+SYSCALL_DEFINE4(top_tasks, struct top_task __user *, by_cpu, struct top_task __user *, by_rss,
+                unsigned int, count, u64 __user *, interval_ns) {
+    struct pid_namespace *ns = task_active_pid_ns(current);
+    struct top_entry *entries;
+    unsigned int max, found;
+    u64 interval;
+    bool wait;
+    long ret_val;
+
+    // 1. VALIDACIONES
+    if (!by_cpu || !by_rss || count == 0 || count > TOP_TASKS_MAX)
+        return -EINVAL;
+
+    // 2. MEMORIA PARA EL RECORRIDO (se reserva antes de entrar a la sección RCU)
+    max = nr_processes() + TOP_SNAPSHOT_SLACK;
+    entries = kvmalloc_array(max, sizeof(*entries), GFP_KERNEL);
+    if (!entries)
+        return -ENOMEM;
+
+    // 3. SI LA FOTO ANTERIOR ES MUY VIEJA, UNA NUEVA Y 100ms DE MEDICIÓN
+    // La espera va sin el lock, si no cada consulta concurrente esperaría 100ms más.
+    // Si otra consulta deja su foto mientras tanto, el intervalo se mide desde esa.
+    if (mutex_lock_killable(&top_lock)) {
+        ret_val = -EINTR;
+        goto free_entries;
+    }
+    wait = !top_prev || ktime_get_ns() - top_prev_ns > TOP_SNAPSHOT_MAX_AGE;
+    if (wait) {
+        found = top_collect(entries, max, ns);
+        top_update(entries, found, ktime_get_ns());
+    }
+    mutex_unlock(&top_lock);
+    if (wait)
+        msleep(100);
+
+    // 4. RECORRER LOS PROCESOS (una consulta a la vez: comparten la foto anterior)
+    if (mutex_lock_killable(&top_lock)) {
+        ret_val = -EINTR;
+        goto free_entries;
+    }
+    found = top_collect(entries, max, ns);
+    interval = top_update(entries, found, ktime_get_ns());
+    mutex_unlock(&top_lock);
+    found = top_visible(entries, found);
+
+    // 5. LOS N PRIMEROS DE CADA ORDEN
+    count = min(count, found);
+    sort(entries, found, sizeof(*entries), top_cmp_cpu, NULL);
+    ret_val = top_copy(by_cpu, entries, count, interval);
+    if (ret_val < 0)
+        goto free_entries;
+    sort(entries, found, sizeof(*entries), top_cmp_rss, NULL);
+    ret_val = top_copy(by_rss, entries, count, interval);
+    if (ret_val < 0)
+        goto free_entries;
+
+    if (interval_ns && put_user(interval, interval_ns)) {
+        ret_val = -EFAULT;
+        goto free_entries;
+    }
+    ret_val = count;
+
+free_entries:
+    kvfree(entries);
+    return ret_val;
+}
@@ -13,6 +13,12 @@
 #define sys_my_encrypt 553
 #define sys_my_decrypt 554
 
+// Modos de kernel_logs (kernel/syscall_logs.c)
+#define KERNEL_LOGS_TEXT 0
+
+#define CRYPT_MODE_XOR 0
+#define CRYPT_MODE_CHACHA20 1
+
 void showLast5Logs() {
     #define LOG_BUFFER_SIZE 448
     char logs_buffer[LOG_BUFFER_SIZE];
@@ -20,7 +26,7 @@ void showLast5Logs() {
     long resultLogs;
     //Inicialr el buffer para evitar basura en la memoria 
     memset(logs_buffer, 0, LOG_BUFFER_SIZE);
-    resultLogs = syscall(sys_kernel_logs, logs_buffer, LOG_BUFFER_SIZE, &actual_length);
+    resultLogs = syscall(sys_kernel_logs, logs_buffer, LOG_BUFFER_SIZE, &actual_length, KERNEL_LOGS_TEXT);
     if (resultLogs == 0) {
         logs_buffer[actual_length] = '\0'; // Asegurar que el buffer este null-terminated
         printf("Longuitud real de logs: %d\n", actual_length);
@@ -68,11 +74,12 @@ void showRAMusage() {
 void cryptAnalizer(int syscall_number) {
     char file_input[256] = {0}, file_output[256] = {0}, key[256] = {0};
     int threads_numbers = 0;
+    int mode = CRYPT_MODE_XOR;
     char command[256];
     bool run = true;
 
     while(run){
-        printf("\nIngrese un parametro (-p, -o, -k, -j o run para ejecutar): ");
+        printf("\nIngrese un parametro (-p, -o, -k, -j, -m o run para ejecutar): ");
         fgets(command, sizeof(command), stdin);
         command[strcspn(command, "\n")] = 0;
 
@@ -92,20 +99,26 @@ void cryptAnalizer(int syscall_number) {
             key[strcspn(key, "\n")] = 0;
 
         } else if (strcmp(command, "-j") == 0) {
-            printf("Número de hilos: ");
+            printf("Número de hilos (0 = automático): ");
             scanf("%d", &threads_numbers);
             getchar();
 
+        } else if (strcmp(command, "-m") == 0) {
+            printf("Modo (0 = XOR, 1 = ChaCha20; sumar 256 para salida con I/O directo, 1024 para comprimir con LZ4): ");
+            scanf("%d", &mode);
+            getchar();
+
         } else if (strcmp(command, "run") == 0) {
 
-            if (strlen(file_input) == 0 || strlen(file_output) == 0 || strlen(key) == 0 || threads_numbers == 0) {
+            if (strlen(file_input) == 0 || strlen(file_output) == 0 || strlen(key) == 0 || threads_numbers < 0) {
                 printf("\nFaltan parametros obligatorios ...\n");
                 continue;
             }
 
-            long result = syscall(syscall_number, file_input, file_output, key, threads_numbers);
+            unsigned int checksum = 0; // CRC32C del archivo cifrado entero
+            long result = syscall(syscall_number, file_input, file_output, key, threads_numbers, mode, &checksum);
             if (result >= 0)
-                printf("Archivo encriptado exitosamente\n");
+                printf("Archivo encriptado exitosamente (checksum %08x)\n", checksum);
             else
                 printf("Ocurrió un error\n");
 
@@ -116,6 +129,86 @@ void cryptAnalizer(int syscall_number) {
     }
 }
 
+// Lee la línea de 'clase' de /sys/kernel/debug/so2_crypt/pool (stored, hits, misses)
+bool readPoolCounters(const char *class_name, unsigned long long *hits, unsigned long long *misses) {
+    char line[256], name[32];
+    unsigned long long stored;
+    bool found = false;
+    FILE *file = fopen("/sys/kernel/debug/so2_crypt/pool", "r");
+
+    if (!file)
+        return false;
+    while (fgets(line, sizeof(line), file)) {
+        if (sscanf(line, "%31s %llu %llu %llu", name, &stored, hits, misses) == 4 &&
+            strcmp(name, class_name) == 0) {
+            found = true;
+            break;
+        }
+    }
+    fclose(file);
+    return found;
+}
+
+// Prueba del pool: dos cifrados seguidos de 64 MiB con 64 hilos (8 grupos, un anillo
+// de 24 pedazos). El segundo tiene que sacar todos sus pedazos del pool.
+// Hay que correrlo como root (debugfs).
+int testPoolReuse() {
+    #define POOL_TEST_SIZE (64UL << 20)
+    #define POOL_TEST_THREADS 64
+    const char *input = "/tmp/so2_pool_test.in", *output = "/tmp/so2_pool_test.out";
+    const char *key = "/tmp/so2_pool_test.key";
+    unsigned long long hits_before, misses_before, hits_after, misses_after;
+    static char block[1 << 20];
+    FILE *file;
+    long result;
+    int i;
+
+    // Archivo de entrada y clave
+    for (i = 0; i < (int)sizeof(block); i++)
+        block[i] = (char)(i * 31 + 7);
+    file = fopen(input, "w");
+    if (!file)
+        return 1;
+    for (i = 0; i < (int)(POOL_TEST_SIZE / sizeof(block)); i++)
+        fwrite(block, 1, sizeof(block), file);
+    fclose(file);
+    file = fopen(key, "w");
+    if (!file)
+        return 1;
+    fputs("clave-de-prueba-del-pool", file);
+    fclose(file);
+
+    // Primera llamada: llena el pool (puede reservar)
+    result = syscall(sys_my_encrypt, input, output, key, POOL_TEST_THREADS, CRYPT_MODE_XOR, NULL);
+    if (result < 0) {
+        printf("Pool: el primer cifrado falló (%ld)\n", result);
+        return 1;
+    }
+    if (!readPoolCounters("chunk", &hits_before, &misses_before)) {
+        printf("Pool: no se pudo leer /sys/kernel/debug/so2_crypt/pool (¿root? ¿debugfs montado?)\n");
+        return 1;
+    }
+
+    // Segunda llamada: todo el anillo tiene que salir del pool
+    result = syscall(sys_my_encrypt, input, output, key, POOL_TEST_THREADS, CRYPT_MODE_XOR, NULL);
+    if (result < 0 || !readPoolCounters("chunk", &hits_after, &misses_after)) {
+        printf("Pool: el segundo cifrado falló (%ld)\n", result);
+        return 1;
+    }
+    unlink(input);
+    unlink(output);
+    unlink(key);
+
+    printf("Pool: segundo cifrado con %llu pedazos reusados y %llu reservados\n",
+           hits_after - hits_before, misses_after - misses_before);
+    if (hits_after == hits_before || misses_after != misses_before) {
+        printf("Pool: FALLO, el segundo cifrado tuvo que reservar pedazos\n");
+        return 1;
+    }
+    printf("Pool: OK\n");
+    return 0;
+}
+
 void analizer() {
     char command[256];
     bool run = true;
@@ -128,7 +221,8 @@ void analizer() {
         printf("4. Ver el uso de RAM\n");
         printf("5. Encriptar - Multithreading\n");
         printf("6. Desencriptar - Multithreading\n");
-        printf("7. Salir\n\n");
+        printf("7. Salir\n");
+        printf("8. Prueba: el pool reusa el anillo entre llamadas (root)\n\n");
         fgets(command, sizeof(command), stdin);
         command[strcspn(command, "\n")] = 0;
 
@@ -150,6 +244,9 @@ void analizer() {
         else if (strcmp(command, "1") == 0) {
             showLast5Logs();
         } 
+        else if (strcmp(command, "8") == 0) {
+            testPoolReuse();
+        }
         else if (strcmp(command, "7") == 0) {
             printf("Hemos finalizado :)\n");
             run = false;
@@ -162,10 +259,14 @@ void analizer() {
 
 
 int main(int argc, char *argv[]) {
+    // ./test pool: solo la prueba del pool, sin menú (el código de salida dice si pasó)
+    if (argc > 1 && strcmp(argv[1], "pool") == 0)
+        return testPoolReuse();
     analizer();
 
     return 0;
 }
 
 // gcc test.c -o test 
-// ./test 100 100
\ No newline at end of file
+// ./test 100 100
+// sudo ./test pool
\ No newline at end of file